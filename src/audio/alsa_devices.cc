@@ -12,7 +12,6 @@
 
 #include "alsa_devices.hh"
 #include "exception.hh"
-#include "timestamp.hh"
 
 using namespace std;
 using namespace std::chrono;
@@ -229,8 +228,8 @@ bool AudioInterface::update()
   }
 
   if ( state() == SND_PCM_STATE_RUNNING ) {
-    statistics_.min_delay = min( statistics_.min_delay, delay() );
-    statistics_.max_delay = max( statistics_.max_delay, delay() );
+    record_delay( delay() );
+    clock_anchor_.emplace( cursor_ - min( cursor_, size_t( delay_ ) ), steady_clock::now() );
   }
 
   return false;
@@ -240,6 +239,7 @@ void AudioInterface::recover()
 {
   statistics_.recoveries++;
   statistics_.last_recovery = cursor();
+  clock_anchor_.reset();
   drop();
   prepare();
 }
@@ -295,25 +295,6 @@ void AudioInterface::prepare()
   check_state( SND_PCM_STATE_PREPARED );
 }
 
-inline float sample_to_float( const int32_t sample )
-{
-  if ( sample & 0xff ) {
-    throw runtime_error( "invalid sample: " + to_string( sample ) );
-  }
-  constexpr float maxval = uint64_t( 1 ) << 31;
-  const float ret = sample / maxval;
-  if ( ret > 1.0 or ret < -1.0 ) {
-    throw runtime_error( "invalid sample: " + to_string( sample ) );
-  }
-  return ret;
-}
-
-inline int32_t float_to_sample( const float sample_f )
-{
-  constexpr float maxval = uint64_t( 1 ) << 31;
-  return lrint( clamp( sample_f, -1.0f, 1.0f ) * maxval );
-}
-
 void AudioInterface::play( const size_t play_until_sample, const ChannelPair& playback_input )
 {
   statistics_.wakeups++;
@@ -329,28 +310,22 @@ void AudioInterface::play( const size_t play_until_sample, const ChannelPair& pl
     return;
   }
 
-  const unsigned int samples_available_to_play = play_until_sample - cursor();
-
-  Buffer write_buf { *this, samples_available_to_play };
-
-  const unsigned int frames_to_play = write_buf.frame_count();
+  /* convert and interleave straight into the mmap area, which is a ring: the frames may come in two pieces */
+  const unsigned int frames_to_play = min( play_until_sample - cursor(), size_t( avail() ) );
 
   if ( frames_to_play == 0 ) {
     throw runtime_error( "AudioInterface::play(): no available buffer space" );
   }
 
-  for ( unsigned int i = 0; i < frames_to_play; i++ ) {
-    /* play from input buffer + captured sample */
-    const auto playback_sample = playback_input.safe_get( cursor_ );
+  for ( unsigned int frames_left = frames_to_play; frames_left > 0; ) {
+    Buffer write_buf { *this, frames_left };
+    playback_input.copy_interleaved_s32( cursor_, write_buf.frame_count(), write_buf.frames() );
+    write_buf.commit();
 
-    write_buf.sample( false, i ) = float_to_sample( playback_sample.first );
-    write_buf.sample( true, i ) = float_to_sample( playback_sample.second );
-
-    cursor_++;
+    cursor_ += write_buf.frame_count();
+    frames_left -= write_buf.frame_count();
   }
 
-  write_buf.commit();
-
   if ( delay() + frames_to_play >= config_.start_threshold and state() == SND_PCM_STATE_PREPARED ) {
     start();
   }
@@ -412,31 +387,84 @@ AudioInterface::Buffer::~Buffer()
   }
 }
 
-void AudioInterface::summary( ostream& out ) const
+RawMidiInput::RawMidiInput( const string& name )
+  : name_( name )
+  , rawmidi_( nullptr )
+  , fd_()
+  , kernel_timestamps_( false )
 {
-  out << name() << " statistics: ";
+  const string diagnostic = "snd_rawmidi_open(" + name_ + ")";
+  alsa_check( diagnostic, snd_rawmidi_open( &rawmidi_, nullptr, name_.c_str(), SND_RAWMIDI_NONBLOCK ) );
+  notnull( diagnostic, rawmidi_ );
 
-  out << " cursor=";
-  pp_samples( out, cursor() );
+  /* ask for each read to come with the CLOCK_MONOTONIC time (the steady_clock) the kernel received it */
+  {
+    struct params_deleter
+    {
+      void operator()( snd_rawmidi_params_t* x ) const { snd_rawmidi_params_free( x ); }
+    };
+
+    unique_ptr<snd_rawmidi_params_t, params_deleter> params { [] {
+      snd_rawmidi_params_t* x = nullptr;
+      alsa_check_easy( snd_rawmidi_params_malloc( &x ) );
+      return x;
+    }() };
+
+    alsa_check_easy( snd_rawmidi_params_current( rawmidi_, params.get() ) );
+#if SND_LIB_VERSION >= 0x010206
+    kernel_timestamps_
+      = snd_rawmidi_params_set_read_mode( rawmidi_, params.get(), SND_RAWMIDI_READ_TSTAMP ) >= 0
+        and snd_rawmidi_params_set_clock_type( rawmidi_, params.get(), SND_RAWMIDI_CLOCK_MONOTONIC ) >= 0
+        and snd_rawmidi_params( rawmidi_, params.get() ) >= 0;
+#endif
+  }
+
+  if ( not kernel_timestamps_ ) {
+    cerr << name_ << ": no kernel timestamps for MIDI input (needs Linux 5.14 and alsa-lib 1.2.6); "
+         << "timing events when they are read instead\n";
+  }
 
-  out << " wakeups=" << statistics().wakeups;
+  const int count = alsa_check_easy( snd_rawmidi_poll_descriptors_count( rawmidi_ ) );
+  if ( count != 1 ) {
+    throw runtime_error( "unexpected fd count: " + to_string( count ) );
+  }
 
-  out << " delay=[" << statistics().min_delay << ".." << statistics().max_delay << "]";
+  pollfd pollfds[1];
+  alsa_check_easy( snd_rawmidi_poll_descriptors( rawmidi_, pollfds, count ) );
+  fd_.emplace( CheckSystemCall( "dup RawMidiInput fd", dup( pollfds[0].fd ) ) );
+}
 
-  if ( statistics().recoveries ) {
-    out << " total recoveries=" << statistics().recoveries;
+size_t RawMidiInput::read( string_span buffer, steady_clock::time_point& arrival )
+{
+  fd_.value().register_read();
+
+  ssize_t ret;
+  arrival = steady_clock::now();
+
+#if SND_LIB_VERSION >= 0x010206
+  if ( kernel_timestamps_ ) {
+    /* on Linux, the steady_clock is CLOCK_MONOTONIC */
+    timespec tstamp {};
+    ret = snd_rawmidi_tread( rawmidi_, &tstamp, buffer.mutable_data(), buffer.size() );
+    arrival = steady_clock::time_point( seconds( tstamp.tv_sec ) + nanoseconds( tstamp.tv_nsec ) );
+  } else
+#endif
+  {
+    ret = snd_rawmidi_read( rawmidi_, buffer.mutable_data(), buffer.size() );
   }
 
-  if ( statistics().last_recovery ) {
-    out << " last recovery=";
-    pp_samples( out, cursor() - statistics().last_recovery );
+  if ( ret == -EAGAIN ) {
+    return 0;
   }
 
-  out << "\n";
+  return alsa_check( "snd_rawmidi_read(" + name_ + ")", ret );
 }
 
-void AudioInterface::reset_summary()
+RawMidiInput::~RawMidiInput()
 {
-  statistics_.min_delay = std::numeric_limits<unsigned int>::max();
-  statistics_.max_delay = 0;
+  try {
+    alsa_check( "snd_rawmidi_close(" + name_ + ")", snd_rawmidi_close( rawmidi_ ) );
+  } catch ( const exception& e ) {
+    cerr << "Exception in destructor: " << e.what() << endl;
+  }
 }
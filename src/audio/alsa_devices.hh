@@ -1,15 +1,14 @@
 #pragma once
 
 #include <alsa/asoundlib.h>
+#include <chrono>
 #include <cmath>
 #include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
-#include "audio_buffer.hh"
-#include "file_descriptor.hh"
-#include "summarize.hh"
+#include "audio_output.hh"
 
 class ALSADevices
 {
@@ -25,27 +24,8 @@ public:
   static std::pair<std::string, std::string> find_device( const std::vector<std::string_view> descriptions );
 };
 
-class PCMFD : public FileDescriptor
-{
-public:
-  using FileDescriptor::FileDescriptor;
-
-  using FileDescriptor::register_read;
-  using FileDescriptor::register_write;
-};
-
-struct AudioStatistics
-{
-  size_t last_recovery;
-  unsigned int recoveries;
-
-  /* these statistics are reset every stats interval */
-  unsigned int wakeups;
-  unsigned int min_delay { std::numeric_limits<unsigned int>::max() };
-  unsigned int max_delay;
-};
-
-class AudioInterface : public Summarizable
+/* an ALSA playback device */
+class AudioInterface : public AudioOutput
 {
   std::string interface_name_, annotation_;
   snd_pcm_t* pcm_;
@@ -57,10 +37,6 @@ class AudioInterface : public Summarizable
 
   snd_pcm_sframes_t avail_ {}, delay_ {};
 
-  size_t cursor_ {};
-
-  AudioStatistics statistics_ {};
-
   class Buffer
   {
     snd_pcm_t* pcm_;
@@ -74,10 +50,8 @@ class AudioInterface : public Summarizable
     void commit() { commit( frame_count_ ); }
     ~Buffer();
 
-    int32_t& sample( const bool right_channel, const unsigned int sample_num )
-    {
-      return *( static_cast<int32_t*>( areas_[0].addr ) + right_channel + 2 * ( offset_ + sample_num ) );
-    }
+    /* the frame_count() interleaved stereo frames to fill */
+    int32_t* frames() { return static_cast<int32_t*>( areas_[0].addr ) + 2 * offset_; }
 
     /* can't copy or assign */
     Buffer( const Buffer& other ) = delete;
@@ -86,50 +60,26 @@ class AudioInterface : public Summarizable
     unsigned int frame_count() const { return frame_count_; }
   };
 
-public:
-  struct Configuration
-  {
-    unsigned int sample_rate { 48000 }; // samples per second
-    unsigned int avail_minimum { 48 };  // minimum samples that have to be available in buffer to trigger event
-    unsigned int period_size { 48 };    // samples per "period" -- kernel will generally return units of this
-    unsigned int buffer_size { 192 };   // default size of buffer
-
-    unsigned int start_threshold { 24 }; // how many samples to accumulate before starting playback
-  };
-
-private:
-  Configuration config_ {};
-
 public:
   AudioInterface( const std::string_view interface_name,
                   const std::string_view annotation,
                   const snd_pcm_stream_t stream );
 
-  void initialize();
+  void initialize() override;
   void start();
   void prepare();
   void drop();
-  void recover();
+  void recover() override;
   bool update();
 
-  const Configuration& config() const { return config_; }
-  void set_config( const Configuration& other ) { config_ = other; }
-
-  const AudioStatistics& statistics() const { return statistics_; }
-
   snd_pcm_state_t state() const;
   unsigned int avail() const { return avail_; }
   unsigned int delay() const { return delay_; }
 
-  std::string name() const;
-  const FileDescriptor& fd() { return fd_.value(); };
-
-  size_t cursor() const { return cursor_; }
+  std::string name() const override;
+  const FileDescriptor& fd() override { return fd_.value(); };
 
-  void play( const size_t play_until_sample, const ChannelPair& playback );
-
-  void summary( std::ostream& out ) const override;
-  void reset_summary() override;
+  void play( const size_t play_until_sample, const ChannelPair& playback ) override;
 
   ~AudioInterface();
 
@@ -155,3 +105,29 @@ inline float dbfs_to_float( const float dbfs )
 
   return exp10( dbfs / 20 );
 }
+
+/* MIDI input from an ALSA rawmidi device (e.g. "hw:1,0,0"), with the kernel's timestamp of when each batch of bytes
+   arrived (on kernels and alsa-lib that support it; otherwise, when it was read) */
+class RawMidiInput
+{
+  std::string name_;
+  snd_rawmidi_t* rawmidi_;
+  std::optional<PCMFD> fd_;
+  bool kernel_timestamps_;
+
+public:
+  explicit RawMidiInput( const std::string& name );
+  ~RawMidiInput();
+
+  /* read bytes that arrived together (at most buffer.size()), and when they arrived; 0 if none are waiting */
+  size_t read( string_span buffer, std::chrono::steady_clock::time_point& arrival );
+
+  bool kernel_timestamps() const { return kernel_timestamps_; }
+
+  const std::string& name() const { return name_; }
+  const FileDescriptor& fd() { return fd_.value(); }
+
+  /* can't copy or assign */
+  RawMidiInput( const RawMidiInput& other ) = delete;
+  RawMidiInput& operator=( const RawMidiInput& other ) = delete;
+};
@@ -0,0 +1,69 @@
+#include "audio_buffer.hh"
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/* scale, clamp and round, as float_to_sample() does */
+#if defined( __AVX2__ )
+static inline __m256i to_s32( const float* in )
+{
+  const __m256 scaled = _mm256_mul_ps( _mm256_loadu_ps( in ), _mm256_set1_ps( 2147483648.0f ) );
+  return _mm256_cvtps_epi32(
+    _mm256_min_ps( _mm256_max_ps( scaled, _mm256_set1_ps( -2147483648.0f ) ), _mm256_set1_ps( 2147483520.0f ) ) );
+}
+#elif defined( __SSE2__ )
+static inline __m128i to_s32( const float* in )
+{
+  const __m128 scaled = _mm_mul_ps( _mm_loadu_ps( in ), _mm_set1_ps( 2147483648.0f ) );
+  return _mm_cvtps_epi32(
+    _mm_min_ps( _mm_max_ps( scaled, _mm_set1_ps( -2147483648.0f ) ), _mm_set1_ps( 2147483520.0f ) ) );
+}
+#endif
+
+void interleave_s32( const float* left, const float* right, const size_t count, int32_t* out )
+{
+  size_t i = 0;
+
+#if defined( __AVX2__ )
+  for ( ; i + 8 <= count; i += 8 ) {
+    const __m256i l = to_s32( left + i ), r = to_s32( right + i );
+
+    /* unpacking works within each 128-bit lane: lo holds frames 0 1 | 4 5, and hi holds frames 2 3 | 6 7 */
+    const __m256i lo = _mm256_unpacklo_epi32( l, r );
+    const __m256i hi = _mm256_unpackhi_epi32( l, r );
+    _mm256_storeu_si256( (__m256i*)( out + 2 * i ), _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+    _mm256_storeu_si256( (__m256i*)( out + 2 * i + 8 ), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+  }
+#elif defined( __SSE2__ )
+  for ( ; i + 4 <= count; i += 4 ) {
+    const __m128i l = to_s32( left + i ), r = to_s32( right + i );
+    _mm_storeu_si128( (__m128i*)( out + 2 * i ), _mm_unpacklo_epi32( l, r ) );
+    _mm_storeu_si128( (__m128i*)( out + 2 * i + 4 ), _mm_unpackhi_epi32( l, r ) );
+  }
+#endif
+
+  for ( ; i < count; i++ ) {
+    out[2 * i] = float_to_sample( left[i] );
+    out[2 * i + 1] = float_to_sample( right[i] );
+  }
+}
+
+void ChannelPair::copy_interleaved_s32( const size_t pos, const size_t count, int32_t* out ) const
+{
+  /* the buffered part of [pos, pos + count), which is contiguous in both channels however the ring has wrapped */
+  const size_t begin = clamp( range_begin(), pos, pos + count );
+  const size_t end = clamp( range_end(), begin, pos + count );
+
+  fill( out, out + 2 * ( begin - pos ), 0 );
+  if ( end > begin ) {
+    const size_t frames = end - begin;
+    interleave_s32(
+      ch1_.region( begin, frames ).data(), ch2_.region( begin, frames ).data(), frames, out + 2 * ( begin - pos ) );
+  }
+  fill( out + 2 * ( end - pos ), out + 2 * count, 0 );
+}
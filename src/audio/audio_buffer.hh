@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
 #include "typed_ring_buffer.hh"
 
 using AudioChannel = SafeEndlessBuffer<float>;
@@ -41,9 +46,40 @@ public:
     ch2_.safe_set( index, val.second );
   }
 
+  /* frames [pos, pos + count) as interleaved S32 (see interleave_s32), with silence for any frames outside the
+     buffered range, as safe_get() gives */
+  void copy_interleaved_s32( const size_t pos, const size_t count, int32_t* out ) const;
+
   AudioChannel& ch1() { return ch1_; }
   AudioChannel& ch2() { return ch2_; }
 
   const AudioChannel& ch1() const { return ch1_; }
   const AudioChannel& ch2() const { return ch2_; }
 };
+
+/* conversion to and from the S32 samples the sound card uses */
+inline float sample_to_float( const int32_t sample )
+{
+  if ( sample & 0xff ) {
+    throw std::runtime_error( "invalid sample: " + std::to_string( sample ) );
+  }
+  constexpr float maxval = uint64_t( 1 ) << 31;
+  const float ret = sample / maxval;
+  if ( ret > 1.0 or ret < -1.0 ) {
+    throw std::runtime_error( "invalid sample: " + std::to_string( sample ) );
+  }
+  return ret;
+}
+
+inline int32_t float_to_sample( const float sample_f )
+{
+  /* +1.0 scales to 2^31, one past the largest S32, so positive samples stop at the largest float below that */
+  constexpr float maxval = uint64_t( 1 ) << 31;
+  constexpr float max_positive = maxval - 128;
+  return lrint( std::clamp( sample_f * maxval, -maxval, max_positive ) );
+}
+
+/* Convert count frames of left and right to interleaved S32 samples (L R L R ...), as float_to_sample() does.
+   Uses AVX2 (8 frames per iteration) or SSE2 (4 frames) when the compiler targets them, and finishes the tail
+   one frame at a time; both round to nearest, so the results are identical. */
+void interleave_s32( const float* left, const float* right, const size_t count, int32_t* out );
@@ -0,0 +1,252 @@
+#include "audio_output.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+size_t AudioOutput::sample_at( const steady_clock::time_point time ) const
+{
+  if ( not clock_anchor_.has_value() ) {
+    /* not playing yet: nothing has left the device */
+    return cursor_;
+  }
+
+  const auto [anchor_sample, anchor_time] = clock_anchor_.value();
+  const double offset = duration<double>( time - anchor_time ).count() * config_.sample_rate;
+  return max( 0.0, anchor_sample + offset );
+}
+
+void AudioOutput::record_delay( const unsigned int delay )
+{
+  statistics_.min_delay = min( statistics_.min_delay, delay );
+  statistics_.max_delay = max( statistics_.max_delay, delay );
+}
+
+void AudioOutput::summary( ostream& out ) const
+{
+  out << name() << " statistics: ";
+
+  out << " cursor=";
+  pp_samples( out, cursor() );
+
+  out << " wakeups=" << statistics().wakeups;
+
+  out << " delay=[" << statistics().min_delay << ".." << statistics().max_delay << "]";
+
+  if ( statistics().recoveries ) {
+    out << " total recoveries=" << statistics().recoveries;
+  }
+
+  if ( statistics().last_recovery ) {
+    out << " last recovery=";
+    pp_samples( out, cursor() - statistics().last_recovery );
+  }
+
+  out << "\n";
+}
+
+void AudioOutput::reset_summary()
+{
+  statistics_.min_delay = std::numeric_limits<unsigned int>::max();
+  statistics_.max_delay = 0;
+}
+
+shared_ptr<AudioOutput> AudioOutput::open_without_hardware( const string_view spec )
+{
+  if ( spec == "null" ) {
+    return make_shared<NullAudioOutput>( spec, NullAudioOutput::Pace::RealTime );
+  } else if ( spec == "null-free" ) {
+    return make_shared<NullAudioOutput>( spec, NullAudioOutput::Pace::FreeRunning );
+  } else if ( spec.substr( 0, 5 ) == "file:" ) {
+    return make_shared<FileAudioOutput>( string( spec.substr( 5 ) ), NullAudioOutput::Pace::FreeRunning );
+  } else if ( spec.substr( 0, 8 ) == "file-rt:" ) {
+    return make_shared<FileAudioOutput>( string( spec.substr( 8 ) ), NullAudioOutput::Pace::RealTime );
+  }
+
+  return nullptr;
+}
+
+NullAudioOutput::NullAudioOutput( const string_view name, const Pace pace )
+  : name_( name )
+  , pace_( pace )
+  , fd_( CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+  , clock_( CheckSystemCall( "timerfd_create", timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC ) ) )
+{
+}
+
+NullAudioOutput::~NullAudioOutput()
+{
+  stop_ = true;
+  if ( clock_thread_.joinable() ) {
+    clock_thread_.join();
+  }
+}
+
+void NullAudioOutput::initialize()
+{
+  if ( config_.sample_rate == 0 or config_.period_size == 0 or config_.avail_minimum > config_.buffer_size ) {
+    throw runtime_error( name() + ": invalid configuration" );
+  }
+
+  if ( pace_ == Pace::FreeRunning or clock_thread_.joinable() ) {
+    return;
+  }
+
+  /* tick once per period */
+  const uint64_t period_ns = uint64_t( config_.period_size ) * 1000000000 / config_.sample_rate;
+  const timespec period { time_t( period_ns / 1000000000 ), long( period_ns % 1000000000 ) };
+  const itimerspec timer { period, period };
+  CheckSystemCall( "timerfd_settime", timerfd_settime( clock_.fd_num(), 0, &timer, nullptr ) );
+
+  clock_thread_ = thread( [this] {
+    try {
+      clock_loop();
+    } catch ( const exception& e ) {
+      cerr << name() << " clock: " << e.what() << "\n";
+    }
+  } );
+}
+
+size_t NullAudioOutput::position( const steady_clock::time_point now ) const
+{
+  if ( not running_.has_value() ) {
+    return consumed_;
+  }
+
+  const auto [start_position, start_time] = running_.value();
+  return start_position + size_t( duration<double>( now - start_time ).count() * config_.sample_rate );
+}
+
+void NullAudioOutput::set_writable( const bool writable )
+{
+  if ( writable == writable_ ) {
+    return;
+  }
+
+  /* an eventfd polls writable until its counter reaches its maximum */
+  if ( writable ) {
+    eventfd_t value;
+    CheckSystemCall( "eventfd_read", eventfd_read( fd_.fd_num(), &value ) );
+  } else {
+    CheckSystemCall( "eventfd_write", eventfd_write( fd_.fd_num(), numeric_limits<eventfd_t>::max() - 1 ) );
+  }
+
+  writable_ = writable;
+}
+
+void NullAudioOutput::clock_loop()
+{
+  while ( not stop_ ) {
+    uint64_t expirations;
+    if ( CheckSystemCall( "read timerfd", ::read( clock_.fd_num(), &expirations, sizeof( expirations ) ) )
+         != sizeof( expirations ) ) {
+      throw runtime_error( "short read from timerfd" );
+    }
+
+    /* wake the writer when there's room, or when the device has run dry (play() will count that) */
+    const lock_guard lock { mutex_ };
+    const size_t played = position( steady_clock::now() );
+    if ( played >= cursor_ or config_.buffer_size - ( cursor_ - played ) >= config_.avail_minimum ) {
+      set_writable( true );
+    }
+  }
+}
+
+void NullAudioOutput::recover()
+{
+  const lock_guard lock { mutex_ };
+
+  /* drop whatever was queued */
+  statistics_.recoveries++;
+  statistics_.last_recovery = cursor_;
+  consumed_ = cursor_;
+  running_.reset();
+  clock_anchor_.reset();
+  set_writable( true );
+}
+
+void NullAudioOutput::play( const size_t play_until_sample, const ChannelPair& playback )
+{
+  statistics_.wakeups++;
+
+  if ( play_until_sample <= cursor_ ) {
+    /* nothing to play */
+    return;
+  }
+
+  const size_t first = cursor_;
+  size_t count = play_until_sample - cursor_;
+
+  if ( pace_ == Pace::RealTime ) {
+    const lock_guard lock { mutex_ };
+    const auto now = steady_clock::now();
+    size_t played = position( now );
+
+    if ( running_.has_value() and played > cursor_ ) {
+      /* ran dry: start again from here */
+      statistics_.recoveries++;
+      statistics_.last_recovery = cursor_;
+      consumed_ = played = cursor_;
+      running_.reset();
+      clock_anchor_.reset();
+    }
+
+    if ( running_.has_value() ) {
+      record_delay( cursor_ - played );
+      clock_anchor_.emplace( played, now );
+    }
+
+    count = min( count, config_.buffer_size - ( cursor_ - played ) );
+    cursor_ += count;
+
+    if ( not running_.has_value() and cursor_ - played >= min( config_.start_threshold, config_.buffer_size ) ) {
+      running_.emplace( played, now );
+    }
+
+    set_writable( config_.buffer_size - ( cursor_ - played ) >= config_.avail_minimum );
+  } else {
+    /* taken at once */
+    record_delay( 0 );
+    cursor_ += count;
+  }
+
+  consume( playback, first, count );
+  fd_.register_write();
+}
+
+void NullAudioOutput::consume( const ChannelPair&, const size_t, const size_t ) {}
+
+FileAudioOutput::FileAudioOutput( const string& filename, const Pace pace )
+  : NullAudioOutput( filename, pace )
+  , filename_( filename )
+{
+}
+
+void FileAudioOutput::initialize()
+{
+  NullAudioOutput::initialize();
+
+  file_ = SndfileHandle { filename_, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_24, 2, int( config_.sample_rate ) };
+  if ( file_.error() ) {
+    throw runtime_error( filename_ + ": " + file_.strError() );
+  }
+}
+
+void FileAudioOutput::consume( const ChannelPair& playback, const size_t first, const size_t count )
+{
+  if ( interleaved_.size() < 2 * count ) {
+    interleaved_.resize( 2 * count );
+  }
+
+  playback.copy_interleaved_s32( first, count, interleaved_.data() );
+  if ( file_.writef( interleaved_.data(), count ) != sf_count_t( count ) ) {
+    throw runtime_error( filename_ + ": " + file_.strError() );
+  }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sndfile.hh>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_buffer.hh"
+#include "file_descriptor.hh"
+#include "summarize.hh"
+
+class PCMFD : public FileDescriptor
+{
+public:
+  using FileDescriptor::FileDescriptor;
+
+  using FileDescriptor::register_read;
+  using FileDescriptor::register_write;
+};
+
+struct AudioStatistics
+{
+  size_t last_recovery;
+  unsigned int recoveries;
+
+  /* these statistics are reset every stats interval */
+  unsigned int wakeups;
+  unsigned int min_delay { std::numeric_limits<unsigned int>::max() };
+  unsigned int max_delay;
+};
+
+/* Where the synthesized signal goes: a sound card (AudioInterface), or a stand-in that needs no hardware. Every
+   backend has an fd that polls writable when there's room for more audio, and play() counts a write on it. */
+class AudioOutput : public Summarizable
+{
+public:
+  struct Configuration
+  {
+    unsigned int sample_rate { 48000 }; // samples per second
+    unsigned int avail_minimum { 48 };  // minimum samples that have to be available in buffer to trigger event
+    unsigned int period_size { 48 };    // samples per "period" -- kernel will generally return units of this
+    unsigned int buffer_size { 192 };   // default size of buffer
+
+    unsigned int start_threshold { 24 }; // how many samples to accumulate before starting playback
+  };
+
+protected:
+  Configuration config_ {};
+  AudioStatistics statistics_ {};
+  size_t cursor_ {};
+
+  /* the sample leaving the device (cursor - delay) as of the last update, and when that was */
+  std::optional<std::pair<size_t, std::chrono::steady_clock::time_point>> clock_anchor_ {};
+
+  void record_delay( const unsigned int delay );
+
+public:
+  const Configuration& config() const { return config_; }
+  void set_config( const Configuration& other ) { config_ = other; }
+
+  const AudioStatistics& statistics() const { return statistics_; }
+
+  size_t cursor() const { return cursor_; }
+
+  /* the sample that was (or will be) leaving the device at a given time, extrapolated at the nominal sample rate
+     from the last update */
+  size_t sample_at( const std::chrono::steady_clock::time_point time ) const;
+
+  virtual std::string name() const = 0;
+  virtual const FileDescriptor& fd() = 0;
+
+  virtual void initialize() = 0;
+  virtual void recover() = 0;
+
+  /* write [cursor(), play_until_sample) of playback, or as much of it as there's room for */
+  virtual void play( const size_t play_until_sample, const ChannelPair& playback ) = 0;
+
+  void summary( std::ostream& out ) const override;
+  void reset_summary() override;
+
+  /* "null" (consumes samples in real time), "null-free" (as fast as they come), "file:PATH" (writes them to a
+     24-bit WAV file, as fast as they come) or "file-rt:PATH" (same, in real time); otherwise null, which means an
+     ALSA device */
+  static std::shared_ptr<AudioOutput> open_without_hardware( const std::string_view spec );
+};
+
+/* An output device that plays to nowhere. Paced in RealTime, it behaves like a sound card: a timerfd ticks once per
+   period, the device consumes config().sample_rate frames a second once config().start_threshold are queued, and
+   fd() polls writable while config().avail_minimum frames of config().buffer_size are free. Running dry counts as
+   a recovery, and playback restarts. FreeRunning, it takes everything it's offered at once, so the rest of the
+   pipeline runs as fast as it can. */
+class NullAudioOutput : public AudioOutput
+{
+public:
+  enum class Pace
+  {
+    RealTime,
+    FreeRunning
+  };
+
+private:
+  std::string name_;
+  Pace pace_;
+
+  PCMFD fd_;                  /* an eventfd, saturated (so unwritable) while the buffer is full */
+  FileDescriptor clock_;      /* a timerfd, read by the clock thread */
+  std::mutex mutex_ {};       /* everything below, and the cursor, against the clock thread */
+  bool writable_ = true;      /* fd_ isn't saturated */
+  size_t consumed_ = 0;       /* frames the device had consumed when last stopped */
+  std::optional<std::pair<size_t, std::chrono::steady_clock::time_point>> running_ {}; /* started from, and when */
+
+  std::atomic<bool> stop_ { false };
+  std::thread clock_thread_ {};
+
+  /* frames the device has consumed by now (past the cursor, if it has run dry) */
+  size_t position( const std::chrono::steady_clock::time_point now ) const;
+  void set_writable( const bool writable );
+  void clock_loop();
+
+protected:
+  /* frames [first, first + count) of playback have been accepted */
+  virtual void consume( const ChannelPair& playback, const size_t first, const size_t count );
+
+public:
+  NullAudioOutput( const std::string_view name, const Pace pace );
+  ~NullAudioOutput();
+
+  std::string name() const override { return name_; }
+  const FileDescriptor& fd() override { return fd_; }
+
+  void initialize() override;
+  void recover() override;
+  void play( const size_t play_until_sample, const ChannelPair& playback ) override;
+
+  /* can't copy or assign */
+  NullAudioOutput( const NullAudioOutput& other ) = delete;
+  NullAudioOutput& operator=( const NullAudioOutput& other ) = delete;
+};
+
+/* a NullAudioOutput that writes what it consumes to a 24-bit stereo WAV file */
+class FileAudioOutput : public NullAudioOutput
+{
+  std::string filename_;
+  SndfileHandle file_ {};
+  std::vector<int32_t> interleaved_ {};
+
+  void consume( const ChannelPair& playback, const size_t first, const size_t count ) override;
+
+public:
+  FileAudioOutput( const std::string& filename, const Pace pace );
+
+  void initialize() override;
+};
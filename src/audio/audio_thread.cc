@@ -0,0 +1,179 @@
+#include "audio_thread.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+using namespace std::chrono;
+
+AudioThread::AudioThread( shared_ptr<AudioOutput> playback, Synthesizer& synth, const Configuration& config )
+  : playback_( playback )
+  , synth_( synth )
+  , config_( config )
+{
+  if ( config_.lock_memory and mlockall( MCL_CURRENT | MCL_FUTURE ) < 0 ) {
+    /* usually the memlock limit: keep going, but say so */
+    cerr << "AudioThread: could not lock memory: " << strerror( errno ) << " (continuing unlocked)\n";
+  }
+
+  thread_ = thread( [this] {
+    try {
+      become_realtime();
+      loop();
+    } catch ( ... ) {
+      error_ = current_exception();
+      failed_.store( true, memory_order_release );
+    }
+  } );
+}
+
+AudioThread::~AudioThread()
+{
+  stop_ = true;
+  thread_.join();
+}
+
+void AudioThread::become_realtime()
+{
+  if ( config_.cpu.has_value() ) {
+    cpu_set_t cpus;
+    CPU_ZERO( &cpus );
+    CPU_SET( config_.cpu.value(), &cpus );
+    if ( const int err = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) ) {
+      throw unix_error( "pthread_setaffinity_np( CPU " + to_string( config_.cpu.value() ) + " )", err );
+    }
+  }
+
+  sched_param param {};
+  param.sched_priority = config_.priority;
+  if ( const int err = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param ) ) {
+    /* usually EPERM (no rtprio limit): keep going, but say so */
+    cerr << "AudioThread: could not use SCHED_FIFO priority " << config_.priority << ": " << strerror( err )
+         << " (continuing without real-time scheduling)\n";
+  } else {
+    realtime_ = true;
+  }
+
+  /* touch the stack we'll need, so it doesn't fault in later */
+  array<char, 256 * 1024> stack_prefault;
+  memset( stack_prefault.data(), 0, stack_prefault.size() );
+  asm volatile( "" : : "r"( stack_prefault.data() ) : "memory" );
+}
+
+bool AudioThread::push( const MidiEvent& event )
+{
+  if ( not events_.try_push( event ) ) {
+    events_dropped_.fetch_add( 1, memory_order_relaxed );
+    return false;
+  }
+
+  return true;
+}
+
+void AudioThread::process_events()
+{
+  const span_view<MidiEvent> events = events_.readable_region();
+  for ( const MidiEvent& event : events ) {
+    synth_.schedule( playback_->sample_at( event.arrival ) + config_.latency, event );
+  }
+
+  events_.pop( events.size() );
+}
+
+void AudioThread::loop()
+{
+  pollfd pcm { playback_->fd().fd_num(), POLLOUT, 0 };
+
+  while ( not stop_ ) {
+    /* apply any new MIDI, and commit to an output signal a little ahead of the playback cursor */
+    process_events();
+
+    const size_t horizon = playback_->cursor() + config_.render_ahead;
+    if ( samples_written_ <= horizon ) {
+      const auto render_start = steady_clock::now();
+
+      const size_t count = horizon + 1 - samples_written_;
+      synth_.render( samples_written_,
+                     audio_signal_.ch1().region( samples_written_, count ),
+                     audio_signal_.ch2().region( samples_written_, count ) );
+      samples_written_ += count;
+
+      /* (a compare-exchange, so a reset_summary() from the event loop isn't overwritten with an older maximum) */
+      const uint64_t render_ns = duration_cast<nanoseconds>( steady_clock::now() - render_start ).count();
+      uint64_t max_ns = max_render_ns_.load( memory_order_relaxed );
+      while ( render_ns > max_ns
+              and not max_render_ns_.compare_exchange_weak( max_ns, render_ns, memory_order_relaxed ) ) {
+      }
+    }
+
+    /* wait (briefly, so a stop request is noticed) for room in the playback buffer */
+    pcm.revents = 0;
+    if ( CheckSystemCall( "poll", ::poll( &pcm, 1, 10 ) ) == 0 ) {
+      continue;
+    }
+
+    wakeups_.fetch_add( 1, memory_order_relaxed );
+
+    if ( pcm.revents & ( POLLERR | POLLHUP | POLLNVAL ) ) {
+      /* buffer overrun/underrun: recover the ALSA interface */
+      playback_->recover();
+    } else if ( pcm.revents & POLLOUT ) {
+      playback_->play( samples_written_, audio_signal_ );
+      audio_signal_.pop_before( playback_->cursor() );
+    }
+
+    cursor_.store( playback_->cursor(), memory_order_relaxed );
+    recoveries_.store( playback_->statistics().recoveries, memory_order_relaxed );
+  }
+}
+
+void AudioThread::check() const
+{
+  if ( failed_.load( memory_order_acquire ) ) {
+    rethrow_exception( error_ );
+  }
+}
+
+void AudioThread::summary( ostream& out ) const
+{
+  out << "audio thread:";
+  out << ( realtime_ ? " SCHED_FIFO/" + to_string( config_.priority ) : string( " not real-time" ) );
+
+  if ( config_.cpu.has_value() ) {
+    out << " cpu=" << config_.cpu.value();
+  }
+
+  out << " cursor=";
+  pp_samples( out, cursor_.load( memory_order_relaxed ) );
+
+  out << " wakeups=" << wakeups_.load( memory_order_relaxed );
+  out << " max render=" << max_render_ns_.load( memory_order_relaxed ) / 1000 << " us";
+  out << " MIDI events=" << events_.num_popped();
+
+  if ( events_dropped_.load( memory_order_relaxed ) ) {
+    out << " dropped=" << events_dropped_.load( memory_order_relaxed );
+  }
+
+  out << " total recoveries=" << recoveries_.load( memory_order_relaxed );
+
+  if ( failed_.load( memory_order_acquire ) ) {
+    out << " STOPPED";
+  }
+
+  out << "\n";
+}
+
+void AudioThread::reset_summary()
+{
+  wakeups_ = 0;
+  max_render_ns_ = 0;
+}
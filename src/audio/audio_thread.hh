@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include "alsa_devices.hh"
+#include "summarize.hh"
+#include "synthesizer.hh"
+#include "typed_ring_buffer.hh"
+
+/* Renders the synthesizer and feeds the playback device from a thread of its own, so nothing else the event loop
+   does (reading MIDI, printing statistics) can delay the audio. The event loop hands MIDI events over with push(),
+   which never blocks. Once started, the thread owns the AudioOutput and the Synthesizer: other threads may only
+   call push() and summary() (and Synthesizer::streamer()'s summary). */
+class AudioThread : public Summarizable
+{
+public:
+  struct Configuration
+  {
+    int priority { 80 };                /* SCHED_FIFO priority (1..99) */
+    std::optional<unsigned int> cpu {}; /* pin the thread to this CPU */
+    bool lock_memory { true };          /* mlockall() so the audio path never page-faults */
+    unsigned int render_ahead { 64 };   /* render up to this many samples past the playback cursor */
+    unsigned int latency { 192 };       /* play each MIDI event this many samples after it arrived */
+  };
+
+private:
+  /* pushed by the event loop, popped by the audio thread */
+  SPSCRingBuffer<MidiEvent> events_ { 4096 };
+
+  std::shared_ptr<AudioOutput> playback_;
+  Synthesizer& synth_;
+  Configuration config_;
+
+  ChannelPair audio_signal_ { 16384 };
+  size_t samples_written_ = 0;
+
+  std::atomic<bool> stop_ { false };
+  std::atomic<bool> realtime_ { false };
+  std::exception_ptr error_ {};
+  std::atomic<bool> failed_ { false };
+
+  /* published by the audio thread for summary() */
+  std::atomic<size_t> cursor_ { 0 };
+  std::atomic<unsigned int> recoveries_ { 0 };
+  std::atomic<unsigned int> events_dropped_ { 0 };
+  std::atomic<unsigned int> wakeups_ { 0 };   /* since the last summary */
+  std::atomic<uint64_t> max_render_ns_ { 0 }; /* since the last summary */
+
+  std::thread thread_ {};
+
+  void become_realtime();
+  void loop();
+  void process_events();
+
+public:
+  /* playback must be initialized; the thread starts right away */
+  AudioThread( std::shared_ptr<AudioOutput> playback, Synthesizer& synth, const Configuration& config );
+  ~AudioThread();
+
+  /* event-loop thread: queue an event for the synthesizer (false, and counted, if the queue is full) */
+  bool push( const MidiEvent& event );
+
+  /* rethrow anything that stopped the audio thread */
+  void check() const;
+
+  void summary( std::ostream& out ) const override;
+  void reset_summary() override;
+
+  /* can't copy or assign */
+  AudioThread( const AudioThread& other ) = delete;
+  AudioThread& operator=( const AudioThread& other ) = delete;
+};
@@ -0,0 +1,93 @@
+#include "event_schedule.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+EventSchedule::EventSchedule( const size_t capacity )
+  : events_()
+{
+  events_.reserve( capacity );
+}
+
+bool EventSchedule::add( const size_t sample, const MidiEvent& event )
+{
+  if ( events_.size() == events_.capacity() ) {
+    /* reclaim the popped events at the front (without reallocating) */
+    events_.erase( events_.begin(), events_.begin() + next_ );
+    next_ = 0;
+
+    if ( events_.size() == events_.capacity() ) {
+      return false;
+    }
+  }
+
+  /* events nearly always arrive in order, so this is usually the end; equal samples keep their arrival order */
+  const auto position
+    = upper_bound( events_.begin() + next_, events_.end(), sample, []( const size_t s, const auto& scheduled ) {
+        return s < scheduled.first;
+      } );
+  events_.emplace( position, sample, event );
+  return true;
+}
+
+optional<size_t> EventSchedule::next_sample() const
+{
+  if ( next_ == events_.size() ) {
+    return {};
+  }
+
+  return events_[next_].first;
+}
+
+MidiEvent EventSchedule::pop( const size_t now )
+{
+  if ( next_ == events_.size() ) {
+    throw runtime_error( "EventSchedule::pop: no events" );
+  }
+
+  const auto [sample, event] = events_[next_++];
+  if ( next_ == events_.size() ) {
+    events_.clear();
+    next_ = 0;
+  }
+
+  applied_.fetch_add( 1, memory_order_relaxed );
+  if ( now > sample ) {
+    late_.fetch_add( 1, memory_order_relaxed );
+    /* (a compare-exchange, so a reset_summary() from another thread isn't overwritten with an older maximum) */
+    uint64_t max_late = max_late_samples_.load( memory_order_relaxed );
+    while ( now - sample > max_late
+            and not max_late_samples_.compare_exchange_weak( max_late, now - sample, memory_order_relaxed ) ) {
+    }
+  }
+
+  return event;
+}
+
+void EventSchedule::summary( ostream& out ) const
+{
+  out << "MIDI timing:";
+  out << " events=" << applied_.load( memory_order_relaxed );
+  out << " late=" << late_.load( memory_order_relaxed );
+
+  if ( late_.load( memory_order_relaxed ) ) {
+    /* the schedule doesn't know the sample rate, so this stays in samples */
+    out << " (by up to " << max_late_samples_.load( memory_order_relaxed ) << " samples)";
+  }
+
+  if ( off_keyboard_.load( memory_order_relaxed ) ) {
+    out << " off-keyboard=" << off_keyboard_.load( memory_order_relaxed );
+  }
+
+  out << "\n";
+}
+
+void EventSchedule::reset_summary()
+{
+  applied_ = 0;
+  late_ = 0;
+  max_late_samples_ = 0;
+  off_keyboard_ = 0;
+}
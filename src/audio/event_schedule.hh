@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "midi_processor.hh"
+#include "summarize.hh"
+
+/* MIDI events waiting for the output sample they take effect at, in order. Storage is allocated once, at
+   construction, so scheduling and applying events never allocate. */
+class EventSchedule : public Summarizable
+{
+  std::vector<std::pair<size_t, MidiEvent>> events_;
+  size_t next_ = 0; /* events before this have been popped */
+
+  /* since the last summary */
+  std::atomic<unsigned int> applied_ { 0 };
+  std::atomic<unsigned int> late_ { 0 };          /* applied after their sample */
+  std::atomic<uint64_t> max_late_samples_ { 0 };
+  std::atomic<unsigned int> off_keyboard_ { 0 }; /* notes outside the piano's range, dropped */
+
+public:
+  explicit EventSchedule( const size_t capacity );
+
+  /* false if the schedule is full */
+  bool add( const size_t sample, const MidiEvent& event );
+
+  /* the sample of the earliest waiting event */
+  std::optional<size_t> next_sample() const;
+
+  /* remove the earliest waiting event, now being applied at sample now */
+  MidiEvent pop( const size_t now );
+
+  /* a note was dropped because no key plays it (a drum channel, or a transposed note) */
+  void count_off_keyboard() { off_keyboard_.fetch_add( 1, std::memory_order_relaxed ); }
+
+  void summary( std::ostream& out ) const override;
+  void reset_summary() override;
+};
@@ -0,0 +1,189 @@
+#include "midi_file.hh"
+#include "mmap.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+/* big-endian fields, with bounds checks */
+class Parser
+{
+  string_view input_;
+  string filename_;
+
+public:
+  Parser( const string_view input, const string& filename )
+    : input_( input )
+    , filename_( filename )
+  {
+  }
+
+  bool empty() const { return input_.empty(); }
+
+  string_view bytes( const size_t count )
+  {
+    if ( count > input_.size() ) {
+      throw runtime_error( filename_ + ": truncated MIDI file" );
+    }
+    const string_view ret = input_.substr( 0, count );
+    input_.remove_prefix( count );
+    return ret;
+  }
+
+  /* the next count bytes, to parse on their own */
+  Parser chunk( const size_t count ) { return { bytes( count ), filename_ }; }
+
+  uint8_t peek() const
+  {
+    if ( input_.empty() ) {
+      throw runtime_error( filename_ + ": truncated MIDI file" );
+    }
+    return input_.front();
+  }
+
+  uint32_t integer( const size_t count )
+  {
+    uint32_t ret = 0;
+    for ( const char c : bytes( count ) ) {
+      ret = ( ret << 8 ) | uint8_t( c );
+    }
+    return ret;
+  }
+
+  /* variable-length quantity: seven bits a byte, high bit set on all but the last */
+  uint32_t vlq()
+  {
+    uint32_t ret = 0;
+    for ( unsigned int i = 0; i < 4; i++ ) {
+      const uint8_t byte = integer( 1 );
+      ret = ( ret << 7 ) | ( byte & 0x7f );
+      if ( not( byte & 0x80 ) ) {
+        return ret;
+      }
+    }
+    throw runtime_error( filename_ + ": variable-length quantity longer than 4 bytes" );
+  }
+
+  [[noreturn]] void error( const string& what ) const { throw runtime_error( filename_ + ": " + what ); }
+};
+
+/* an event as found in a track, before the tempo map is applied */
+struct TrackEvent
+{
+  uint64_t tick;
+  uint32_t tempo; /* microseconds per quarter note, for tempo changes (otherwise zero) */
+  MidiEvent event;
+};
+
+void parse_track( Parser track, vector<TrackEvent>& events, uint64_t& end_tick )
+{
+  uint64_t tick = 0;
+  uint8_t running_status = 0;
+
+  while ( not track.empty() ) {
+    tick += track.vlq();
+
+    const uint8_t status = track.peek() & 0x80 ? track.integer( 1 ) : running_status;
+
+    if ( status == 0xff ) {
+      /* meta event */
+      const uint8_t type = track.integer( 1 );
+      Parser data = track.chunk( track.vlq() );
+      running_status = 0;
+
+      if ( type == 0x51 ) {
+        if ( const uint32_t tempo = data.integer( 3 ) ) {
+          events.push_back( { tick, tempo, {} } );
+        }
+      } else if ( type == 0x2f ) {
+        break; /* end of track */
+      }
+    } else if ( status == 0xf0 or status == 0xf7 ) {
+      /* SysEx, or an escape */
+      track.bytes( track.vlq() );
+      running_status = 0;
+    } else if ( status & 0x80 and status < 0xf0 ) {
+      running_status = status;
+      const uint8_t first_data = track.integer( 1 );
+      const bool two_data_bytes = ( status & 0xf0 ) != 0xc0 and ( status & 0xf0 ) != 0xd0;
+      const uint8_t second_data = two_data_bytes ? track.integer( 1 ) : 0;
+      events.push_back( { tick, 0, { status, first_data, second_data } } );
+    } else {
+      track.error( "unexpected status byte " + to_string( status ) + " at tick " + to_string( tick ) );
+    }
+  }
+
+  end_tick = max( end_tick, tick );
+}
+
+}
+
+MidiFile::MidiFile( const string& filename )
+{
+  const ReadOnlyFile file { filename };
+  Parser input { file, filename };
+
+  if ( input.bytes( 4 ) != "MThd" ) {
+    input.error( "not a Standard MIDI File" );
+  }
+
+  Parser header = input.chunk( input.integer( 4 ) );
+  format_ = header.integer( 2 );
+  track_count_ = header.integer( 2 );
+  const uint16_t division = header.integer( 2 );
+
+  if ( format_ > 1 ) {
+    input.error( "MIDI file format " + to_string( format_ ) + " is not supported (only 0 and 1)" );
+  }
+
+  /* all tracks play at once, sharing the tempo map (which is usually in the first) */
+  vector<TrackEvent> track_events;
+  uint64_t end_tick = 0;
+  for ( unsigned int found = 0; found < track_count_ and not input.empty(); ) {
+    const string_view type = input.bytes( 4 );
+    Parser chunk = input.chunk( input.integer( 4 ) );
+    if ( type == "MTrk" ) {
+      parse_track( chunk, track_events, end_tick );
+      found++;
+    }
+  }
+
+  /* a stable sort keeps the order within each tick: tempo changes in earlier tracks come first */
+  stable_sort( track_events.begin(), track_events.end(), []( const TrackEvent& a, const TrackEvent& b ) {
+    return a.tick < b.tick;
+  } );
+
+  /* ticks are fractions of a quarter note (so depend on the tempo), or of an SMPTE frame */
+  double quarter_notes_per_tick = 0, seconds_per_tick = 0;
+  if ( division & 0x8000 ) {
+    const int frames_per_second = -int8_t( division >> 8 );
+    const double rate = frames_per_second == 29 ? 30000.0 / 1001 : frames_per_second;
+    seconds_per_tick = 1.0 / ( rate * ( division & 0xff ) );
+  } else {
+    if ( division == 0 ) {
+      input.error( "zero ticks per quarter note" );
+    }
+    quarter_notes_per_tick = 1.0 / division;
+    seconds_per_tick = quarter_notes_per_tick * 0.5; /* 120 beats per minute until told otherwise */
+  }
+
+  double time = 0;
+  uint64_t last_tick = 0;
+  for ( const auto& e : track_events ) {
+    time += ( e.tick - last_tick ) * seconds_per_tick;
+    last_tick = e.tick;
+
+    if ( e.tempo ) {
+      if ( quarter_notes_per_tick ) {
+        seconds_per_tick = quarter_notes_per_tick * e.tempo / 1e6;
+      }
+    } else {
+      events_.push_back( { time, e.event } );
+    }
+  }
+
+  duration_ = time + ( end_tick - last_tick ) * seconds_per_tick;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "midi_processor.hh"
+
+/* A Standard MIDI File (format 0 or 1), as one list of channel messages in time order. Times follow the file's
+   tempo map (or its SMPTE timing); SysEx and meta events other than tempo changes are skipped. */
+class MidiFile
+{
+public:
+  struct TimedEvent
+  {
+    double time; /* seconds from the start of the file */
+    MidiEvent event;
+  };
+
+private:
+  std::vector<TimedEvent> events_ {};
+  unsigned int format_ = 0;
+  unsigned int track_count_ = 0;
+  double duration_ = 0; /* until the last event in any track, including end-of-track */
+
+public:
+  explicit MidiFile( const std::string& filename );
+
+  const std::vector<TimedEvent>& events() const { return events_; }
+  unsigned int format() const { return format_; }
+  unsigned int track_count() const { return track_count_; }
+  double duration() const { return duration_; }
+};
@@ -1,4 +1,5 @@
 #include "midi_processor.hh"
+#include "alsa_devices.hh"
 #include "eventloop.hh"
 #include "exception.hh"
 #include <fcntl.h>
@@ -10,27 +11,135 @@ using namespace chrono;
 void MidiProcessor::read_from_fd( FileDescriptor& fd )
 {
   unprocessed_midi_bytes_.push_from_fd( fd );
+  input_arrived();
+}
+
+void MidiProcessor::input_arrived()
+{
+  last_read_time_ = steady_clock::now();
+
+  parse();
+}
+
+void MidiProcessor::read_from_rawmidi( RawMidiInput& input )
+{
+  while ( want_read() ) {
+    const size_t bytes_read = input.read( unprocessed_midi_bytes_.writable_region(), last_read_time_ );
+    if ( bytes_read == 0 ) {
+      break;
+    }
+
+    unprocessed_midi_bytes_.push( bytes_read );
+    parse();
+  }
+}
 
-  pop_active_sense_bytes();
+void MidiProcessor::read_from_str( string_view& str )
+{
+  unprocessed_midi_bytes_.read_from_str( str );
+  last_read_time_ = steady_clock::now();
+
+  parse();
 }
 
-float MidiProcessor::pop_event()
+void MidiProcessor::pop_event()
 {
-  while ( unprocessed_midi_bytes_.readable_region().size() >= 3 ) {
-    unprocessed_midi_bytes_.pop( 3 );
-    pop_active_sense_bytes();
+  events_.pop( 1 );
+
+  /* pick up where parsing stopped if the events filled up */
+  if ( unprocessed_midi_bytes_.bytes_stored() ) {
+    parse();
   }
+}
+
+float MidiProcessor::time_since_reset() const
+{
   return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now()
                                                                 - last_event_time_ )
     .count()/1000.0;
 }
 
-void MidiProcessor::pop_active_sense_bytes()
+/* data bytes that follow a status byte */
+static uint8_t data_length( const uint8_t status )
+{
+  switch ( status & 0xf0 ) {
+    case 0xc0: /* program change */
+    case 0xd0: /* channel pressure */
+      return 1;
+    case 0xf0:
+      switch ( status ) {
+        case 0xf1: /* MIDI time code quarter frame */
+        case 0xf3: /* song select */
+          return 1;
+        case 0xf2: /* song position */
+          return 2;
+        default:
+          return 0;
+      }
+    default:
+      return 2;
+  }
+}
+
+void MidiProcessor::emit( const uint8_t status, const uint8_t first_data, const uint8_t second_data )
 {
-  while ( unprocessed_midi_bytes_.readable_region().size()
-          and uint8_t( unprocessed_midi_bytes_.readable_region().at( 0 ) ) == 0xfe ) {
-    unprocessed_midi_bytes_.pop( 1 );
+  events_.writable_region()[0] = { status, first_data, second_data, last_read_time_ };
+  events_.push( 1 );
+}
+
+void MidiProcessor::parse()
+{
+  const string_view bytes = unprocessed_midi_bytes_.readable_region();
+
+  size_t i = 0;
+  for ( ; i < bytes.size() and events_.num_stored() < events_.capacity(); i++ ) {
+    const uint8_t byte = bytes[i];
+
+    if ( byte >= 0xf8 ) {
+      /* realtime (clock, active sense...) can come anywhere, even inside another message */
+      realtime_bytes_++;
+      continue;
+    }
+
+    if ( byte & 0x80 ) {
+      /* any status byte ends a SysEx (0xf7 is the proper way) and starts a new message */
+      in_sysex_ = byte == 0xf0;
+      status_ = 0;
+      data_count_ = 0;
+
+      if ( byte == 0xf0 or byte == 0xf7 ) {
+        sysex_bytes_++;
+      } else if ( data_length( byte ) ) {
+        status_ = byte;
+      } else {
+        emit( byte, 0, 0 ); /* tune request */
+      }
+      continue;
+    }
+
+    if ( in_sysex_ ) {
+      sysex_bytes_++;
+      continue;
+    }
+
+    if ( not status_ ) {
+      stray_bytes_++;
+      continue;
+    }
+
+    data_[data_count_++] = byte;
+    if ( data_count_ == data_length( status_ ) ) {
+      emit( status_, data_[0], data_count_ > 1 ? data_[1] : 0 );
+      data_count_ = 0;
+
+      /* running status: further data bytes repeat a channel message */
+      if ( status_ >= 0xf0 ) {
+        status_ = 0;
+      }
+    }
   }
+
+  unprocessed_midi_bytes_.pop( i );
 }
 
 /* create input vector from midi data */
@@ -52,7 +161,8 @@ std::queue<float> MidiProcessor::nn_midi_input( const string& midi_filename )
     [&] {
       while ( has_event() ) {
         uint8_t event_type = get_event_type();
-        float time_val = pop_event() / 1000.0;
+        float time_val = time_since_reset() / 1000.0;
+        pop_event();
         if ( event_type == 144 ) {
           ret_queue.push( time_val );
           cout << "time val: " << time_val << "\n";
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <optional>
 #include <queue>
@@ -7,36 +8,85 @@
 
 #include "file_descriptor.hh"
 #include "ring_buffer.hh"
+#include "typed_ring_buffer.hh"
 
-/* wrap MIDI file input */
+class RawMidiInput;
+
+/* a MIDI message, and when it arrived */
+struct MidiEvent
+{
+  uint8_t type;     /* status byte: for channel messages, the kind in the high nibble and the channel in the low */
+  uint8_t note;     /* first data byte (zero if none) */
+  uint8_t velocity; /* second data byte (zero if none) */
+  std::chrono::steady_clock::time_point arrival {};
+
+  uint8_t kind() const { return type < 0xf0 ? type & 0xf0 : type; }
+  uint8_t channel() const { return type & 0x0f; }
+};
+
+/* Parses MIDI input into events. The parser follows the MIDI 1.0 byte stream: running status, one- and two-byte
+   messages, realtime bytes (dropped) in the middle of a message, and SysEx (skipped). It works in place on the
+   bytes as read, and keeps what it needs of an incomplete message between reads. */
 class MidiProcessor
 {
   RingBuffer unprocessed_midi_bytes_ { 4096 };
+  TypedRingBuffer<MidiEvent> events_ { 256 };
   const static size_t batch_size = 1;
   const static size_t input_size = 16;
 
+  /* parser state */
+  uint8_t status_ = 0;             /* of the message being received (zero if none) */
+  std::array<uint8_t, 2> data_ {}; /* its data bytes so far */
+  uint8_t data_count_ = 0;
+  bool in_sysex_ = false;
+  std::chrono::steady_clock::time_point last_read_time_ {};
+
+  /* bytes thrown away */
+  size_t sysex_bytes_ = 0, realtime_bytes_ = 0, stray_bytes_ = 0;
+
   std::chrono::steady_clock::time_point last_event_time_ { std::chrono::steady_clock::now() };
 
+  void parse();
+  void emit( const uint8_t status, const uint8_t first_data, const uint8_t second_data );
+
 public:
   std::queue<float> nn_midi_input( const std::string& midi_filename );
 
   void read_from_fd( FileDescriptor& fd );
 
-  float pop_event();
+  /* for an EventLoop read rule: the buffer it reads into, and what to call after it has */
+  RingBuffer& input_buffer() { return unprocessed_midi_bytes_; }
+  void input_arrived();
+
+  /* read everything waiting, keeping the time each batch of bytes arrived */
+  void read_from_rawmidi( RawMidiInput& input );
+
+  /* parse bytes from a string (advancing it past the bytes taken), as if they had been read from a device */
+  void read_from_str( std::string_view& str );
 
-  void pop_active_sense_bytes();
+  void pop_event();
 
   bool want_read() const { return unprocessed_midi_bytes_.writable_region().size() > 0; }
 
-  bool has_event() { return unprocessed_midi_bytes_.readable_region().size() >= 3; }
+  bool has_event() const { return events_.num_stored() > 0; }
+
+  uint8_t get_event_type() const { return get_event().type; }
+  uint8_t get_event_note() const { return get_event().note; }
+  uint8_t get_event_velocity() const { return get_event().velocity; }
+
+  /* when the read that completed the event finished */
+  std::chrono::steady_clock::time_point get_event_arrival() const { return get_event().arrival; }
+
+  const MidiEvent& get_event() const { return events_.readable_region().at( 0 ); }
 
-  uint8_t get_event_type() const { return unprocessed_midi_bytes_.readable_region().at( 0 ); }
-  uint8_t get_event_note() const { return unprocessed_midi_bytes_.readable_region().at( 1 ); }
-  uint8_t get_event_velocity() const { return unprocessed_midi_bytes_.readable_region().at( 2 ); }
+  size_t sysex_bytes() const { return sysex_bytes_; }
+  size_t realtime_bytes() const { return realtime_bytes_; }
+  size_t stray_bytes() const { return stray_bytes_; }
 
   // unsigned int pop_event();
 
   void reset_time() { last_event_time_ = std::chrono::steady_clock::now(); };
+  float time_since_reset() const; /* in seconds */
   std::chrono::steady_clock::time_point get_original_time() { return last_event_time_; };
 
   /* no event or active sense in more than 1 s */
@@ -0,0 +1,221 @@
+#include "mix_kernel.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined( __AVX2__ ) && defined( __FMA__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+void mix_layer_scalar( const float* left_src,
+                       const float* right_src,
+                       const size_t frames,
+                       const float layer_gain,
+                       const float gain,
+                       const float gain_step,
+                       float* left,
+                       float* right )
+{
+  for ( size_t j = 0; j < frames; j++ ) {
+    const float g = max( gain - j * gain_step, 0.0f ) * layer_gain;
+    left[j] += left_src[j] * g;
+    right[j] += right_src[j] * g;
+  }
+}
+
+#if defined( __AVX2__ ) && defined( __FMA__ )
+
+void mix_layer( const float* left_src,
+                const float* right_src,
+                const size_t frames,
+                const float layer_gain,
+                const float gain,
+                const float gain_step,
+                float* left,
+                float* right )
+{
+  const __m256 frame_index = _mm256_setr_ps( 0, 1, 2, 3, 4, 5, 6, 7 );
+  const __m256 step = _mm256_set1_ps( gain_step );
+  const __m256 lgain = _mm256_set1_ps( layer_gain );
+  const __m256 zero = _mm256_setzero_ps();
+
+  size_t j = 0;
+  for ( ; j + 8 <= frames; j += 8 ) {
+    const __m256 index = _mm256_add_ps( _mm256_set1_ps( j ), frame_index );
+    const __m256 g = _mm256_mul_ps( _mm256_max_ps( _mm256_fnmadd_ps( index, step, _mm256_set1_ps( gain ) ), zero ),
+                                    lgain );
+
+    _mm256_storeu_ps( left + j,
+                      _mm256_fmadd_ps( _mm256_loadu_ps( left_src + j ), g, _mm256_loadu_ps( left + j ) ) );
+    _mm256_storeu_ps( right + j,
+                      _mm256_fmadd_ps( _mm256_loadu_ps( right_src + j ), g, _mm256_loadu_ps( right + j ) ) );
+  }
+
+  mix_layer_scalar(
+    left_src + j, right_src + j, frames - j, layer_gain, gain - j * gain_step, gain_step, left + j, right + j );
+}
+
+#elif defined( __SSE2__ )
+
+void mix_layer( const float* left_src,
+                const float* right_src,
+                const size_t frames,
+                const float layer_gain,
+                const float gain,
+                const float gain_step,
+                float* left,
+                float* right )
+{
+  const __m128 frame_index = _mm_setr_ps( 0, 1, 2, 3 );
+  const __m128 step = _mm_set1_ps( gain_step );
+  const __m128 lgain = _mm_set1_ps( layer_gain );
+  const __m128 zero = _mm_setzero_ps();
+
+  size_t j = 0;
+  for ( ; j + 4 <= frames; j += 4 ) {
+    const __m128 index = _mm_add_ps( _mm_set1_ps( j ), frame_index );
+    const __m128 g
+      = _mm_mul_ps( _mm_max_ps( _mm_sub_ps( _mm_set1_ps( gain ), _mm_mul_ps( index, step ) ), zero ), lgain );
+
+    _mm_storeu_ps( left + j,
+                   _mm_add_ps( _mm_loadu_ps( left + j ), _mm_mul_ps( _mm_loadu_ps( left_src + j ), g ) ) );
+    _mm_storeu_ps( right + j,
+                   _mm_add_ps( _mm_loadu_ps( right + j ), _mm_mul_ps( _mm_loadu_ps( right_src + j ), g ) ) );
+  }
+
+  mix_layer_scalar(
+    left_src + j, right_src + j, frames - j, layer_gain, gain - j * gain_step, gain_step, left + j, right + j );
+}
+
+#else
+
+void mix_layer( const float* left_src,
+                const float* right_src,
+                const size_t frames,
+                const float layer_gain,
+                const float gain,
+                const float gain_step,
+                float* left,
+                float* right )
+{
+  mix_layer_scalar( left_src, right_src, frames, layer_gain, gain, gain_step, left, right );
+}
+
+#endif
+
+namespace {
+
+struct LinearInterpolator
+{
+  static float at( const float* x, const float f ) { return x[0] + f * ( x[1] - x[0] ); }
+};
+
+struct CubicInterpolator
+{
+  static float at( const float* x, const float f )
+  {
+    const float xm1 = x[-1], x0 = x[0], x1 = x[1], x2 = x[2];
+    return x0
+           + 0.5f * f
+               * ( x1 - xm1 + f * ( 2 * xm1 - 5 * x0 + 4 * x1 - x2 + f * ( 3 * ( x0 - x1 ) + x2 - xm1 ) ) );
+  }
+};
+
+/* Lanczos (a = 4) weights for taps x[-3] .. x[4], tabulated at SINC_PHASES + 1 fractional offsets.
+   Built during static initialization, so the audio path never allocates or computes a sin(). */
+constexpr size_t SINC_TAPS = 8;
+constexpr size_t SINC_PHASES = 512;
+using SincTable = std::array<std::array<float, SINC_TAPS>, SINC_PHASES + 1>;
+
+SincTable make_sinc_table()
+{
+  auto sinc = []( const double t ) { return t == 0 ? 1.0 : sin( M_PI * t ) / ( M_PI * t ); };
+
+  SincTable table {};
+  for ( size_t phase = 0; phase <= SINC_PHASES; phase++ ) {
+    const double f = double( phase ) / SINC_PHASES;
+    double sum = 0;
+    for ( size_t k = 0; k < SINC_TAPS; k++ ) {
+      const double t = double( k ) - 3 - f;
+      table[phase][k] = sinc( t ) * sinc( t / 4 );
+      sum += table[phase][k];
+    }
+    for ( auto& weight : table[phase] ) {
+      weight /= sum; /* unity gain at DC */
+    }
+  }
+  return table;
+}
+
+const SincTable sinc_table = make_sinc_table();
+
+struct SincInterpolator
+{
+  static float at( const float* x, const float f )
+  {
+    const auto& weights = sinc_table[lrintf( f * SINC_PHASES )];
+    float ret = 0;
+    for ( size_t k = 0; k < SINC_TAPS; k++ ) {
+      ret += x[int( k ) - 3] * weights[k];
+    }
+    return ret;
+  }
+};
+
+template<class Interpolator>
+void resample_loop( const float* left_src,
+                    const float* right_src,
+                    const double position,
+                    const double rate,
+                    const size_t frames,
+                    const float layer_gain,
+                    const float gain,
+                    const float gain_step,
+                    float* left,
+                    float* right )
+{
+  for ( size_t j = 0; j < frames; j++ ) {
+    const double p = position + j * rate;
+    const size_t i = p;
+    const float f = p - i;
+    const float g = max( gain - j * gain_step, 0.0f ) * layer_gain;
+
+    left[j] += Interpolator::at( left_src + i, f ) * g;
+    right[j] += Interpolator::at( right_src + i, f ) * g;
+  }
+}
+
+}
+
+void mix_layer_resampled( const Interpolation quality,
+                          const float* left_src,
+                          const float* right_src,
+                          const double position,
+                          const double rate,
+                          const size_t frames,
+                          const float layer_gain,
+                          const float gain,
+                          const float gain_step,
+                          float* left,
+                          float* right )
+{
+  switch ( quality ) {
+    case Interpolation::Linear:
+      resample_loop<LinearInterpolator>(
+        left_src, right_src, position, rate, frames, layer_gain, gain, gain_step, left, right );
+      break;
+    case Interpolation::Cubic:
+      resample_loop<CubicInterpolator>(
+        left_src, right_src, position, rate, frames, layer_gain, gain, gain_step, left, right );
+      break;
+    case Interpolation::Sinc:
+      resample_loop<SincInterpolator>(
+        left_src, right_src, position, rate, frames, layer_gain, gain, gain_step, left, right );
+      break;
+  }
+}
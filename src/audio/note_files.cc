@@ -7,21 +7,44 @@ static const string suff_slow = "v1-PA.wav";
 static const string suff_med = "v8.5-PA.wav";
 static const string suff_fast = "v16.wav";
 
-NoteFiles::NoteFiles( const string& sample_directory,
-                      const string& note,
-                      const size_t key_num,
-                      const bool has_damper )
-  : slow( sample_directory + note + suff_slow )
-  , med( sample_directory + note + suff_med )
-  , fast( sample_directory + note + suff_fast )
-  , rel( sample_directory + "rel" + to_string( key_num ) + ".wav" )
+NoteFiles::NoteFiles( const Layer& s_slow,
+                      const Layer& s_med,
+                      const Layer& s_fast,
+                      const Layer& s_rel,
+                      const bool has_damper,
+                      const double rate )
+  : slow( s_slow )
+  , med( s_med )
+  , fast( s_fast )
+  , rel( s_rel )
   , has_damper_( has_damper )
+  , rate_( rate )
 {
 }
 
-void NoteFiles::bend_pitch( const double pitch_bend_ratio )
+array<string, 3> NoteFiles::velocity_layer_filenames( const string& note )
 {
-  slow.bend_pitch( pitch_bend_ratio );
-  med.bend_pitch( pitch_bend_ratio );
-  fast.bend_pitch( pitch_bend_ratio );
+  return { note + suff_slow, note + suff_med, note + suff_fast };
+}
+
+string NoteFiles::release_filename( const size_t key_num )
+{
+  return "rel" + to_string( key_num ) + ".wav";
+}
+
+array<NoteFiles::Layer, 3> NoteFiles::load_velocity_layers( const string& sample_directory,
+                                                            const string& note,
+                                                            const SampleFormat format )
+{
+  const auto filenames = velocity_layer_filenames( note );
+  return { make_shared<const WavWrapper>( sample_directory + filenames[0], format ),
+           make_shared<const WavWrapper>( sample_directory + filenames[1], format ),
+           make_shared<const WavWrapper>( sample_directory + filenames[2], format ) };
+}
+
+NoteFiles::Layer NoteFiles::load_release( const string& sample_directory,
+                                          const size_t key_num,
+                                          const SampleFormat format )
+{
+  return make_shared<const WavWrapper>( sample_directory + release_filename( key_num ), format );
 }
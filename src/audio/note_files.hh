@@ -1,28 +1,51 @@
 #pragma once
 
+#include <array>
+#include <memory>
+
 #include "wav_wrapper.hh"
 
+/* the samples for one key: three velocity layers (shared with the neighbouring keys recorded from the same
+   source note) and the key's own release sample */
 class NoteFiles
 {
-  WavWrapper slow;
-  WavWrapper med;
-  WavWrapper fast;
-  WavWrapper rel;
+public:
+  using Layer = std::shared_ptr<const WavWrapper>;
+
+private:
+  Layer slow;
+  Layer med;
+  Layer fast;
+  Layer rel;
 
   bool has_damper_;
+  double rate_;
 
 public:
-  NoteFiles( const std::string& sample_directory,
-             const std::string& note,
-             const size_t key_num,
-             const bool has_damper );
+  NoteFiles( const Layer& s_slow,
+             const Layer& s_med,
+             const Layer& s_fast,
+             const Layer& s_rel,
+             const bool has_damper,
+             const double rate );
+
+  /* file names, within the sample directory */
+  static std::array<std::string, 3> velocity_layer_filenames( const std::string& note );
+  static std::string release_filename( const size_t key_num );
+
+  /* slow, med and fast, as recorded from one source note */
+  static std::array<Layer, 3> load_velocity_layers( const std::string& sample_directory,
+                                                    const std::string& note,
+                                                    const SampleFormat format );
+  static Layer load_release( const std::string& sample_directory, const size_t key_num, const SampleFormat format );
 
-  const WavWrapper& getSlow() const { return slow; };
-  const WavWrapper& getMed() const { return med; };
-  const WavWrapper& getFast() const { return fast; };
-  const WavWrapper& getRel() const { return rel; };
+  const WavWrapper& getSlow() const { return *slow; };
+  const WavWrapper& getMed() const { return *med; };
+  const WavWrapper& getFast() const { return *fast; };
+  const WavWrapper& getRel() const { return *rel; };
 
   bool has_damper() const { return has_damper_; }
 
-  void bend_pitch( const double pitch_bend_ratio );
+  /* source frames per output frame when playing the velocity layers (1 unless they come from a neighbour) */
+  double rate() const { return rate_; }
 };
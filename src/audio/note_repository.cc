@@ -1,127 +1,390 @@
 #include "note_repository.hh"
+#include "exception.hh"
+#include "timer.hh"
 #include "wav_wrapper.hh"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
 #include <iostream>
+#include <map>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace std::chrono;
 
 using namespace std;
 
+constexpr unsigned int SAMPLE_RATE = 48000; /* Hz */
+
 constexpr float LOW_XFOUT_LOVEL = 8;   // Equivalent to MED_XFIN_LOVEL
 constexpr float LOW_XFOUT_HIVEL = 59;  // Equivalent to MED_XFIN_HIVEL
 constexpr float HIGH_XFIN_LOVEL = 67;  // Equivalent to MED_XFOUT_LOVEL
 constexpr float HIGH_XFIN_HIVEL = 119; // Equivalent to MED_XFOUT_HIVEL
 
-NoteRepository::NoteRepository( const string& sample_directory )
+/* Sample bank layout (native byte order):
+     BankHeader
+     BankLayer[layer_count]
+     BankNote[note_count]     (each refers to its layers by index, so shared layers are stored once)
+     sample data: for each layer, its padded left channel then its padded right channel (`stride` samples each, in
+                  the layer's format) then any scales, starting on a 64-byte boundary, exactly as WavWrapper lays
+                  them out */
+struct BankHeader
 {
-  add_notes( sample_directory, "A0", 2 );
-  add_notes( sample_directory, "C1", 3 );
-  add_notes( sample_directory, "D#1", 3 );
-  add_notes( sample_directory, "F#1", 3 );
-  add_notes( sample_directory, "A1", 3 );
-  add_notes( sample_directory, "C2", 3 );
-  add_notes( sample_directory, "D#2", 3 );
-  add_notes( sample_directory, "F#2", 3 );
-  add_notes( sample_directory, "A2", 3 );
-  add_notes( sample_directory, "C3", 3 );
-  add_notes( sample_directory, "D#3", 3 );
-  add_notes( sample_directory, "F#3", 3 );
-  add_notes( sample_directory, "A3", 3 );
-  add_notes( sample_directory, "C4", 3 );
-  add_notes( sample_directory, "D#4", 3 );
-  add_notes( sample_directory, "F#4", 3 );
-  add_notes( sample_directory, "A4", 3 );
-  add_notes( sample_directory, "C5", 3 );
-  add_notes( sample_directory, "D#5", 3 );
-  add_notes( sample_directory, "F#5", 3 );
-  add_notes( sample_directory, "A5", 3 );
-  add_notes( sample_directory, "C6", 3 );
-  add_notes( sample_directory, "D#6", 3 );
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t layer_count;
+  uint32_t note_count;
+  uint32_t reserved;
+};
 
-  // keys below here do not have dampers
-  add_notes( sample_directory, "F#6", 3, false );
-  add_notes( sample_directory, "A6", 3, false );
-  add_notes( sample_directory, "C7", 3, false );
-  add_notes( sample_directory, "D#7", 3, false );
-  add_notes( sample_directory, "F#7", 3, false );
-  add_notes( sample_directory, "A7", 3, false );
-  add_notes( sample_directory, "C8", 2, false );
-
-  cerr << "Added " << notes.size() << " notes\n";
+struct BankLayer
+{
+  uint64_t offset; /* in bytes from start of file, to the left channel's leading zeros */
+  uint64_t length; /* in frames */
+  uint64_t stride; /* in samples */
+  uint32_t format; /* a SampleFormat */
+  uint32_t reserved;
+};
+
+struct BankNote
+{
+  uint32_t layers[4]; /* slow, med, fast, rel */
+  uint32_t has_damper;
+  uint32_t reserved;
+  double rate;
+};
+
+static constexpr std::array<char, 8> BANK_MAGIC { 'p', 'a', 'n', 'c', 'b', 'a', 'n', 'k' };
+static constexpr uint32_t BANK_VERSION = 3;
+
+NoteRepository::NoteRepository( const string& sample_directory,
+                                const SampleFormat format,
+                                const unsigned int resident_ms )
+{
+  const auto start = steady_clock::now();
+
+  struct stat info;
+  CheckSystemCall( "stat( \"" + sample_directory + "\" )", stat( sample_directory.c_str(), &info ) );
+
+  if ( S_ISREG( info.st_mode ) ) {
+    load_bank( sample_directory, resident_ms * ( SAMPLE_RATE / 1000 ) );
+  } else if ( resident_ms ) {
+    throw runtime_error( sample_directory + ": streaming needs a sample bank (see make-sample-bank)" );
+  } else {
+    decode_notes( sample_directory, format );
+  }
+
+  const auto elapsed = duration_cast<milliseconds>( steady_clock::now() - start );
+  cerr << "Added " << notes.size() << " notes in " << elapsed.count() << " ms\n";
 }
 
-const wav_frame_t NoteRepository::get_sample( const bool direction,
-                                              const size_t note,
-                                              const uint8_t velocity,
-                                              const unsigned long offset ) const
+void NoteRepository::decode_notes( const string& sample_directory, const SampleFormat format )
 {
-  if ( direction ) {
-    if ( velocity <= LOW_XFOUT_LOVEL ) {
-      return notes.at( note ).getSlow().view( offset );
-    } else if ( velocity <= LOW_XFOUT_HIVEL ) {
-      std::pair<float, float> new_samp = notes.at( note ).getSlow().view( offset );
-      new_samp.first *= ( LOW_XFOUT_HIVEL - velocity ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL );
-      new_samp.second *= ( LOW_XFOUT_HIVEL - velocity ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL );
+  const vector<NoteJob> jobs = keyboard();
 
-      std::pair<float, float> med_samp = notes.at( note ).getMed().view( offset );
-      new_samp.first += med_samp.first * ( ( velocity - LOW_XFOUT_LOVEL ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL ) );
-      new_samp.second
-        += med_samp.second * ( ( velocity - LOW_XFOUT_LOVEL ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL ) );
+  /* each source note's velocity layers are loaded once, and shared by the keys that play them */
+  vector<string> sources;
+  vector<size_t> source_of_job;
+  for ( const auto& job : jobs ) {
+    if ( sources.empty() or sources.back() != job.name ) {
+      sources.push_back( job.name );
+    }
+    source_of_job.push_back( sources.size() - 1 );
+  }
 
-      return new_samp;
-    } else if ( velocity <= HIGH_XFIN_LOVEL ) {
-      return notes.at( note ).getMed().view( offset );
-    } else if ( velocity <= HIGH_XFIN_HIVEL ) {
-      std::pair<float, float> new_samp = notes.at( note ).getMed().view( offset );
-      new_samp.first *= ( HIGH_XFIN_HIVEL - velocity ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL );
-      new_samp.second *= ( HIGH_XFIN_HIVEL - velocity ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL );
+  vector<array<NoteFiles::Layer, 3>> velocity_layers( sources.size() );
+  vector<NoteFiles::Layer> releases( jobs.size() );
 
-      std::pair<float, float> fast_samp = notes.at( note ).getFast().view( offset );
-      new_samp.first
-        += fast_samp.first * ( ( velocity - HIGH_XFIN_LOVEL ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL ) );
-      new_samp.second
-        += fast_samp.second * ( ( velocity - HIGH_XFIN_LOVEL ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL ) );
+  /* decode on every core; each task fills its own slot, so the order is unchanged */
+  const size_t num_tasks = sources.size() + jobs.size();
+  const size_t num_threads = max( size_t( 1 ), min( size_t( thread::hardware_concurrency() ), num_tasks ) );
+
+  vector<exception_ptr> errors( num_threads );
+  atomic<size_t> next_task { 0 };
+  atomic<uint64_t> velocity_ns { 0 }, release_ns { 0 };
+
+  auto worker = [&]( const size_t thread_id ) {
+    try {
+      for ( size_t i = next_task++; i < num_tasks; i = next_task++ ) {
+        const uint64_t start = Timer::timestamp_ns();
+
+        if ( i < sources.size() ) {
+          velocity_layers[i] = NoteFiles::load_velocity_layers( sample_directory, sources[i], format );
+          velocity_ns += Timer::timestamp_ns() - start;
+        } else {
+          const NoteJob& job = jobs[i - sources.size()];
+          releases[i - sources.size()]
+            = NoteFiles::load_release( sample_directory, job.release_sample_num, format );
+          release_ns += Timer::timestamp_ns() - start;
+        }
+      }
+    } catch ( ... ) {
+      errors[thread_id] = current_exception();
+      next_task = num_tasks; /* stop the other workers early */
+    }
+  };
+
+  const uint64_t wall_start = Timer::timestamp_ns();
+
+  vector<thread> threads;
+  for ( size_t i = 0; i < num_threads; i++ ) {
+    threads.emplace_back( worker, i );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+
+  for ( const auto& error : errors ) {
+    if ( error ) {
+      rethrow_exception( error );
+    }
+  }
+
+  notes.reserve( jobs.size() );
+  for ( size_t i = 0; i < jobs.size(); i++ ) {
+    const auto& layers = velocity_layers[source_of_job[i]];
+    notes.emplace_back( layers[0], layers[1], layers[2], releases[i], jobs[i].has_damper, jobs[i].rate );
+  }
+
+  cerr << "Sample loading with " << num_threads << " threads: wall ";
+  Timer::pp_ns( cerr, Timer::timestamp_ns() - wall_start );
+  cerr << ", velocity layers ";
+  Timer::pp_ns( cerr, velocity_ns );
+  cerr << " (CPU), release samples ";
+  Timer::pp_ns( cerr, release_ns );
+  cerr << " (CPU)\n";
+}
+
+void NoteRepository::load_bank( const string& bank_filename, const size_t resident_frames )
+{
+  const string_view bank = bank_.emplace( bank_filename );
+
+  auto check = [&]( const bool condition, const string& what ) {
+    if ( not condition ) {
+      throw runtime_error( bank_filename + ": " + what );
+    }
+  };
 
-      return new_samp;
+  check( bank.size() >= sizeof( BankHeader ), "too short for a sample bank" );
+  BankHeader header;
+  memcpy( &header, bank.data(), sizeof( header ) );
+  check( header.magic == BANK_MAGIC, "not a sample bank" );
+  check( header.version == BANK_VERSION, "sample bank version " + to_string( header.version ) + ", not "
+                                           + to_string( BANK_VERSION ) );
+
+  const size_t notes_start = sizeof( BankHeader ) + header.layer_count * sizeof( BankLayer );
+  check( bank.size() >= notes_start + header.note_count * sizeof( BankNote ), "truncated index" );
+
+  vector<NoteFiles::Layer> layers;
+  layers.reserve( header.layer_count );
+  for ( size_t i = 0; i < header.layer_count; i++ ) {
+    BankLayer entry;
+    memcpy( &entry, bank.data() + sizeof( BankHeader ) + i * sizeof( BankLayer ), sizeof( entry ) );
+    check( entry.format <= uint32_t( SampleFormat::Float16 ), "unknown sample format" );
+    const SampleFormat format = SampleFormat( entry.format );
+    check( entry.offset + WavWrapper::storage_size( format, entry.stride ) <= bank.size(),
+           "sample data out of range" );
+    auto mapped = make_shared<const WavWrapper>(
+      reinterpret_cast<const uint8_t*>( bank.data() + entry.offset ), format, entry.length, entry.stride );
+
+    if ( resident_frames ) {
+      /* copy out the head; the tail will be read from the bank as it plays */
+      layers.push_back( make_shared<const WavWrapper>( *mapped, resident_frames, entry.offset ) );
     } else {
-      return notes.at( note ).getFast().view( offset );
+      layers.push_back( move( mapped ) );
     }
   }
 
-  return notes.at( note ).getRel().view( offset );
+  auto layer = [&]( const uint32_t index ) {
+    check( index < layers.size(), "layer index out of range" );
+    return layers[index];
+  };
+
+  notes.reserve( header.note_count );
+  for ( size_t i = 0; i < header.note_count; i++ ) {
+    BankNote entry;
+    memcpy( &entry, bank.data() + notes_start + i * sizeof( BankNote ), sizeof( entry ) );
+    notes.emplace_back( layer( entry.layers[0] ),
+                        layer( entry.layers[1] ),
+                        layer( entry.layers[2] ),
+                        layer( entry.layers[3] ),
+                        entry.has_damper,
+                        entry.rate );
+  }
+
+  if ( resident_frames ) {
+    /* nothing refers to the mapping any more, so drop it (and the pages it pulled in) */
+    bank_.reset();
+    streamed_bank_ = bank_filename;
+  }
+}
+
+void NoteRepository::write_bank( const string& bank_filename ) const
+{
+  FileDescriptor file { CheckSystemCall( "open( \"" + bank_filename + "\" )",
+                                         open( bank_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) };
+
+  uint64_t file_size = 0;
+  auto write_all = [&]( string_view data ) {
+    file_size += data.size();
+    while ( not data.empty() ) {
+      data.remove_prefix( file.write( data ) );
+    }
+  };
+
+  auto align = []( const uint64_t offset ) { return ( offset + 63 ) / 64 * 64; };
+
+  /* number each distinct layer, in order of first use */
+  vector<const WavWrapper*> layers;
+  map<const WavWrapper*, uint32_t> layer_index;
+  vector<BankNote> note_index( notes.size() );
+  for ( size_t i = 0; i < notes.size(); i++ ) {
+    const array<const WavWrapper*, 4> note_layers {
+      &notes[i].getSlow(), &notes[i].getMed(), &notes[i].getFast(), &notes[i].getRel() };
+    for ( size_t j = 0; j < note_layers.size(); j++ ) {
+      if ( note_layers[j]->stream_source() ) {
+        throw runtime_error( "write_bank: samples are only partly resident" );
+      }
+      const auto [it, inserted] = layer_index.emplace( note_layers[j], layers.size() );
+      if ( inserted ) {
+        layers.push_back( note_layers[j] );
+      }
+      note_index[i].layers[j] = it->second;
+    }
+    note_index[i].has_damper = notes[i].has_damper();
+    note_index[i].reserved = 0;
+    note_index[i].rate = notes[i].rate();
+  }
+
+  /* lay out the sample data after the index */
+  vector<BankLayer> layer_table( layers.size() );
+  uint64_t next_offset
+    = align( sizeof( BankHeader ) + layers.size() * sizeof( BankLayer ) + notes.size() * sizeof( BankNote ) );
+  for ( size_t i = 0; i < layers.size(); i++ ) {
+    layer_table[i]
+      = { next_offset, layers[i]->length(), layers[i]->stride(), uint32_t( layers[i]->format() ), 0 };
+    next_offset = align( next_offset + layers[i]->padded_storage().size() );
+  }
+
+  const BankHeader header { BANK_MAGIC, BANK_VERSION, uint32_t( layers.size() ), uint32_t( notes.size() ), 0 };
+  write_all( { reinterpret_cast<const char*>( &header ), sizeof( header ) } );
+  write_all( { reinterpret_cast<const char*>( layer_table.data() ), layer_table.size() * sizeof( BankLayer ) } );
+  write_all( { reinterpret_cast<const char*>( note_index.data() ), note_index.size() * sizeof( BankNote ) } );
+
+  const string zeros( 64, 0 );
+  for ( size_t i = 0; i < layers.size(); i++ ) {
+    write_all( string_view( zeros ).substr( 0, layer_table[i].offset - file_size ) );
+
+    write_all( layers[i]->padded_storage() );
+  }
 }
 
-bool NoteRepository::note_finished( const bool direction,
-                                    const size_t note,
-                                    const uint8_t velocity,
-                                    const unsigned long offset ) const
+LayerMix NoteRepository::layers( const bool direction, const size_t note, const uint8_t velocity ) const
 {
+  const NoteFiles& files = notes.at( note );
+
   if ( direction ) {
+    /* a key shifted from its neighbour's recording plays that recording a semitone off */
+    const double rate = files.rate();
+
     if ( velocity <= LOW_XFOUT_LOVEL ) {
-      return notes.at( note ).getSlow().at_end( offset );
+      return { &files.getSlow(), &files.getSlow(), 1, 0, rate };
     } else if ( velocity <= LOW_XFOUT_HIVEL ) {
-      return notes.at( note ).getMed().at_end( offset );
+      return { &files.getSlow(),
+               &files.getMed(),
+               ( LOW_XFOUT_HIVEL - velocity ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL ),
+               ( velocity - LOW_XFOUT_LOVEL ) / ( LOW_XFOUT_HIVEL - LOW_XFOUT_LOVEL ),
+               rate };
     } else if ( velocity <= HIGH_XFIN_LOVEL ) {
-      return notes.at( note ).getMed().at_end( offset );
+      return { &files.getMed(), &files.getMed(), 1, 0, rate };
     } else if ( velocity <= HIGH_XFIN_HIVEL ) {
-      return notes.at( note ).getFast().at_end( offset );
+      return { &files.getMed(),
+               &files.getFast(),
+               ( HIGH_XFIN_HIVEL - velocity ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL ),
+               ( velocity - HIGH_XFIN_LOVEL ) / ( HIGH_XFIN_HIVEL - HIGH_XFIN_LOVEL ),
+               rate };
     } else {
-      return notes.at( note ).getFast().at_end( offset );
+      return { &files.getFast(), &files.getFast(), 1, 0, rate };
+    }
+  }
+
+  /* every key has its own release sample */
+  return { &files.getRel(), &files.getRel(), 1, 0, 1.0 };
+}
+
+vector<NoteRepository::NoteJob> NoteRepository::keyboard()
+{
+  vector<NoteJob> jobs;
+
+  add_notes( jobs, "A0", 2 );
+  add_notes( jobs, "C1", 3 );
+  add_notes( jobs, "D#1", 3 );
+  add_notes( jobs, "F#1", 3 );
+  add_notes( jobs, "A1", 3 );
+  add_notes( jobs, "C2", 3 );
+  add_notes( jobs, "D#2", 3 );
+  add_notes( jobs, "F#2", 3 );
+  add_notes( jobs, "A2", 3 );
+  add_notes( jobs, "C3", 3 );
+  add_notes( jobs, "D#3", 3 );
+  add_notes( jobs, "F#3", 3 );
+  add_notes( jobs, "A3", 3 );
+  add_notes( jobs, "C4", 3 );
+  add_notes( jobs, "D#4", 3 );
+  add_notes( jobs, "F#4", 3 );
+  add_notes( jobs, "A4", 3 );
+  add_notes( jobs, "C5", 3 );
+  add_notes( jobs, "D#5", 3 );
+  add_notes( jobs, "F#5", 3 );
+  add_notes( jobs, "A5", 3 );
+  add_notes( jobs, "C6", 3 );
+  add_notes( jobs, "D#6", 3 );
+
+  // keys below here do not have dampers
+  add_notes( jobs, "F#6", 3, false );
+  add_notes( jobs, "A6", 3, false );
+  add_notes( jobs, "C7", 3, false );
+  add_notes( jobs, "D#7", 3, false );
+  add_notes( jobs, "F#7", 3, false );
+  add_notes( jobs, "A7", 3, false );
+  add_notes( jobs, "C8", 2, false );
+
+  return jobs;
+}
+
+vector<string> NoteRepository::sample_filenames()
+{
+  vector<string> filenames;
+  const vector<NoteJob> jobs = keyboard();
+
+  for ( size_t i = 0; i < jobs.size(); i++ ) {
+    if ( i == 0 or jobs[i].name != jobs[i - 1].name ) {
+      for ( const auto& filename : NoteFiles::velocity_layer_filenames( jobs[i].name ) ) {
+        filenames.push_back( filename );
+      }
     }
+    filenames.push_back( NoteFiles::release_filename( jobs[i].release_sample_num ) );
   }
 
-  return notes.at( note ).getRel().at_end( offset );
+  return filenames;
 }
 
-void NoteRepository::add_notes( const string& sample_directory,
+void NoteRepository::add_notes( vector<NoteJob>& jobs,
                                 const string& name,
                                 const unsigned int num_notes,
                                 const bool has_damper )
 {
-  unsigned int note_num_base = notes.size() + 1;
+  unsigned int note_num_base = jobs.size() + 1;
   for ( unsigned int i = 0; i < num_notes; i++ ) {
     unsigned int release_sample_num = note_num_base + i;
 
-    notes.emplace_back( sample_directory, name, release_sample_num, has_damper );
+    jobs.push_back( { name, release_sample_num, has_damper, 1.0 } );
     /* do we need to bend the pitch? */
 
     const unsigned int pitch_bend_modulus = ( release_sample_num - 1 ) % 3;
@@ -130,10 +393,10 @@ void NoteRepository::add_notes( const string& sample_directory,
       std::cerr << "NOT bending for: " << name << " = " << release_sample_num << "\n";
     } else if ( pitch_bend_modulus == 1 ) {
       std::cerr << "Bending UP from " << name << "\n";
-      notes.back().bend_pitch( pow( 2, -1.0 / 12.0 ) );
+      jobs.back().rate = pow( 2, 1.0 / 12.0 );
     } else {
       std::cerr << "Bending DOWN from " << name << "\n";
-      notes.back().bend_pitch( pow( 2, 1.0 / 12.0 ) );
+      jobs.back().rate = pow( 2, -1.0 / 12.0 );
     }
   }
 }
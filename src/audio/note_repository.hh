@@ -1,27 +1,67 @@
 #pragma once
 
+#include "mmap.hh"
 #include "note_files.hh"
+#include <optional>
 #include <vector>
 
+/* the one or two sample layers a voice reads, with their crossfade gains (resolved once, at note-on) */
+struct LayerMix
+{
+  const WavWrapper* first;
+  const WavWrapper* second; /* same as first (with zero gain) if the velocity isn't in a crossfade zone */
+  float first_gain;
+  float second_gain;
+  double rate; /* source frames per output frame */
+
+  bool at_end( const double position ) const
+  {
+    return position >= first->length() and position >= second->length();
+  }
+};
+
 class NoteRepository
 {
+  std::optional<ReadOnlyFile> bank_ {}; /* backs the notes when loaded from a sample bank; outlives them */
   std::vector<NoteFiles> notes {};
+  std::string streamed_bank_ {}; /* the bank that non-resident samples stream from, if any */
+
+  void decode_notes( const std::string& sample_directory, const SampleFormat format );
+  void load_bank( const std::string& bank_filename, const size_t resident_frames );
 
-  void add_notes( const std::string& sample_directory,
-                  const std::string& name,
-                  const unsigned int num_notes,
-                  const bool has_damper = true );
+  /* one key to load from the sample directory: its release sample, and which source note it plays at what rate */
+  struct NoteJob
+  {
+    std::string name;
+    unsigned int release_sample_num;
+    bool has_damper;
+    double rate;
+  };
+
+  static void add_notes( std::vector<NoteJob>& jobs,
+                         const std::string& name,
+                         const unsigned int num_notes,
+                         const bool has_damper = true );
+
+  /* every key, in order */
+  static std::vector<NoteJob> keyboard();
 
 public:
-  NoteRepository( const std::string& sample_directory );
+  /* sample_directory may be a directory of WAV files (stored in memory as format), or a sample bank file written by
+     write_bank() (which keeps the format it was written with). With a bank and a nonzero resident_ms, only the
+     first resident_ms of each sample is kept in memory, and the rest must be streamed (see SampleStreamer). */
+  NoteRepository( const std::string& sample_directory,
+                  const SampleFormat format = SampleFormat::Float32,
+                  const unsigned int resident_ms = 0 );
+
+  /* the WAV files a sample directory must hold */
+  static std::vector<std::string> sample_filenames();
+
+  /* save the decoded samples, so a later NoteRepository can map them instead */
+  void write_bank( const std::string& bank_filename ) const;
 
-  const wav_frame_t get_sample( const bool direction,
-                                const size_t note,
-                                const uint8_t velocity,
-                                const unsigned long offset ) const;
+  LayerMix layers( const bool direction, const size_t note, const uint8_t velocity ) const;
 
-  bool note_finished( const bool direction,
-                      const size_t note,
-                      const uint8_t velocity,
-                      const unsigned long offset ) const;
+  bool streaming() const { return not streamed_bank_.empty(); }
+  const std::string& streamed_bank() const { return streamed_bank_; }
 };
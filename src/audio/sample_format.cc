@@ -0,0 +1,285 @@
+#include "sample_format.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+size_t bytes_per_sample( const SampleFormat format )
+{
+  switch ( format ) {
+    case SampleFormat::Float32:
+      return 4;
+    case SampleFormat::PCM24:
+      return 3;
+    case SampleFormat::PCM16:
+    case SampleFormat::Float16:
+      return 2;
+  }
+
+  throw runtime_error( "unknown sample format " + to_string( int( format ) ) );
+}
+
+string format_name( const SampleFormat format )
+{
+  switch ( format ) {
+    case SampleFormat::Float32:
+      return "float32";
+    case SampleFormat::PCM24:
+      return "pcm24";
+    case SampleFormat::PCM16:
+      return "pcm16";
+    case SampleFormat::Float16:
+      return "float16";
+  }
+
+  throw runtime_error( "unknown sample format " + to_string( int( format ) ) );
+}
+
+SampleFormat parse_sample_format( const string& name )
+{
+  for ( const auto format :
+        { SampleFormat::Float32, SampleFormat::PCM24, SampleFormat::PCM16, SampleFormat::Float16 } ) {
+    if ( name == format_name( format ) ) {
+      return format;
+    }
+  }
+
+  throw runtime_error( "unknown sample format \"" + name + "\" (expected float32, pcm24, pcm16 or float16)" );
+}
+
+/* 24-bit samples come from the WAV files as floats with at most 24 significant bits, so this is exact */
+static constexpr float PCM24_SCALE = 8388608.0f; /* 2^23 */
+
+static uint16_t float_to_half( const float f )
+{
+  uint32_t x;
+  memcpy( &x, &f, sizeof( x ) );
+
+  const uint16_t sign = ( x >> 16 ) & 0x8000;
+  const uint32_t float_exponent = ( x >> 23 ) & 0xff;
+  const int exponent = int( float_exponent ) - 127 + 15;
+  uint32_t mantissa = x & 0x7fffff;
+
+  if ( float_exponent == 0xff ) {
+    return sign | 0x7c00 | ( mantissa ? 0x200 : 0 ); /* infinity or NaN */
+  }
+
+  if ( exponent >= 31 ) {
+    return sign | 0x7c00; /* too big: infinity */
+  }
+
+  /* round to nearest, ties to even, dropping `shift` bits of mantissa */
+  auto round_shift = []( const uint32_t value, const unsigned int shift ) {
+    const uint32_t kept = value >> shift;
+    const uint32_t rest = value & ( ( 1u << shift ) - 1 );
+    const uint32_t half = 1u << ( shift - 1 );
+    return kept + ( rest > half or ( rest == half and ( kept & 1 ) ) );
+  };
+
+  if ( exponent <= 0 ) {
+    if ( exponent < -10 ) {
+      return sign; /* too small: zero */
+    }
+    /* subnormal */
+    return sign | round_shift( mantissa | 0x800000, 14 - exponent );
+  }
+
+  /* a carry out of the mantissa correctly bumps the exponent (or overflows to infinity) */
+  return sign | ( ( uint32_t( exponent ) << 10 ) + round_shift( mantissa, 13 ) );
+}
+
+static float half_to_float( const uint16_t h )
+{
+  const uint32_t sign = uint32_t( h & 0x8000 ) << 16;
+  const uint32_t exponent = ( h >> 10 ) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+
+  uint32_t x;
+  if ( exponent == 0 ) {
+    const float magnitude = ldexpf( mantissa, -24 ); /* zero or subnormal */
+    memcpy( &x, &magnitude, sizeof( x ) );
+    x |= sign;
+  } else if ( exponent == 31 ) {
+    x = sign | 0x7f800000 | ( mantissa << 13 );
+  } else {
+    x = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+  }
+
+  float f;
+  memcpy( &f, &x, sizeof( f ) );
+  return f;
+}
+
+void encode_samples( const SampleFormat format,
+                     const float* samples,
+                     const size_t count,
+                     uint8_t* channel,
+                     float* scales )
+{
+  switch ( format ) {
+    case SampleFormat::Float32:
+      memcpy( channel, samples, count * sizeof( float ) );
+      return;
+
+    case SampleFormat::PCM24:
+      for ( size_t i = 0; i < count; i++ ) {
+        const int32_t value = clamp( lrintf( samples[i] * PCM24_SCALE ), -8388608L, 8388607L );
+        channel[3 * i] = value;
+        channel[3 * i + 1] = value >> 8;
+        channel[3 * i + 2] = value >> 16;
+      }
+      return;
+
+    case SampleFormat::PCM16:
+      if ( count % SCALE_BLOCK_FRAMES ) {
+        throw runtime_error( "encode_samples: " + to_string( count ) + " samples is not a whole number of blocks" );
+      }
+
+      for ( size_t block = 0; block < count / SCALE_BLOCK_FRAMES; block++ ) {
+        const float* const in = samples + block * SCALE_BLOCK_FRAMES;
+        float peak = 0;
+        for ( size_t i = 0; i < SCALE_BLOCK_FRAMES; i++ ) {
+          peak = max( peak, fabsf( in[i] ) );
+        }
+
+        scales[block] = peak / 32767;
+        const float inverse = peak > 0 ? 32767 / peak : 0;
+        for ( size_t i = 0; i < SCALE_BLOCK_FRAMES; i++ ) {
+          const int16_t value = clamp( lrintf( in[i] * inverse ), -32767L, 32767L );
+          memcpy( channel + 2 * ( block * SCALE_BLOCK_FRAMES + i ), &value, sizeof( value ) );
+        }
+      }
+      return;
+
+    case SampleFormat::Float16:
+      for ( size_t i = 0; i < count; i++ ) {
+        const uint16_t value = float_to_half( samples[i] );
+        memcpy( channel + 2 * i, &value, sizeof( value ) );
+      }
+      return;
+  }
+
+  throw runtime_error( "unknown sample format " + to_string( int( format ) ) );
+}
+
+static void decode_pcm24( const uint8_t* in, const size_t count, float* out )
+{
+  size_t i = 0;
+
+  /* each 16-byte load holds four whole samples; shuffle each into the top three bytes of an int32 (so the sign
+     lands in place), convert, and scale by 2^-31. The loads stop short of reading past the last sample. */
+#if defined( __AVX2__ )
+  const __m256i spread_avx = _mm256_setr_epi8(
+    -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+  const __m256 scale_avx = _mm256_set1_ps( 1.0f / 2147483648.0f );
+  for ( ; i + 10 <= count; i += 8 ) {
+    const __m256i packed
+      = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)( in + 3 * i ) ) ),
+                                 _mm_loadu_si128( (const __m128i*)( in + 3 * i + 12 ) ),
+                                 1 );
+    const __m256i widened = _mm256_shuffle_epi8( packed, spread_avx );
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( widened ), scale_avx ) );
+  }
+#endif
+
+#if defined( __SSSE3__ )
+  const __m128i spread = _mm_setr_epi8( -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+  const __m128 scale = _mm_set1_ps( 1.0f / 2147483648.0f );
+  for ( ; i + 6 <= count; i += 4 ) {
+    const __m128i widened = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)( in + 3 * i ) ), spread );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( widened ), scale ) );
+  }
+#endif
+
+  for ( ; i < count; i++ ) {
+    const int32_t value = int32_t( uint32_t( in[3 * i] ) << 8 | uint32_t( in[3 * i + 1] ) << 16
+                                   | uint32_t( in[3 * i + 2] ) << 24 );
+    out[i] = value * ( 1.0f / 2147483648.0f );
+  }
+}
+
+/* count samples that all share one scale */
+static void decode_pcm16( const uint8_t* in, const float scale_factor, const size_t count, float* out )
+{
+  size_t i = 0;
+
+#if defined( __AVX2__ )
+  const __m256 scale_avx = _mm256_set1_ps( scale_factor );
+  for ( ; i + 8 <= count; i += 8 ) {
+    const __m256i widened = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( in + 2 * i ) ) );
+    _mm256_storeu_ps( out + i, _mm256_mul_ps( _mm256_cvtepi32_ps( widened ), scale_avx ) );
+  }
+#endif
+
+#if defined( __SSE4_1__ )
+  const __m128 scale = _mm_set1_ps( scale_factor );
+  for ( ; i + 4 <= count; i += 4 ) {
+    const __m128i widened = _mm_cvtepi16_epi32( _mm_loadl_epi64( (const __m128i*)( in + 2 * i ) ) );
+    _mm_storeu_ps( out + i, _mm_mul_ps( _mm_cvtepi32_ps( widened ), scale ) );
+  }
+#endif
+
+  for ( ; i < count; i++ ) {
+    int16_t value;
+    memcpy( &value, in + 2 * i, sizeof( value ) );
+    out[i] = value * scale_factor;
+  }
+}
+
+static void decode_float16( const uint8_t* in, const size_t count, float* out )
+{
+  size_t i = 0;
+
+#if defined( __F16C__ )
+  for ( ; i + 8 <= count; i += 8 ) {
+    _mm256_storeu_ps( out + i, _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i*)( in + 2 * i ) ) ) );
+  }
+#endif
+
+  for ( ; i < count; i++ ) {
+    uint16_t value;
+    memcpy( &value, in + 2 * i, sizeof( value ) );
+    out[i] = half_to_float( value );
+  }
+}
+
+void decode_samples( const SampleFormat format,
+                     const uint8_t* channel,
+                     const float* scales,
+                     const size_t first,
+                     const size_t count,
+                     float* out )
+{
+  switch ( format ) {
+    case SampleFormat::Float32:
+      memcpy( out, channel + first * sizeof( float ), count * sizeof( float ) );
+      return;
+
+    case SampleFormat::PCM24:
+      decode_pcm24( channel + 3 * first, count, out );
+      return;
+
+    case SampleFormat::PCM16:
+      /* one run per scale block */
+      for ( size_t i = first; i < first + count; ) {
+        const size_t block = i / SCALE_BLOCK_FRAMES;
+        const size_t run = min( ( block + 1 ) * SCALE_BLOCK_FRAMES, first + count ) - i;
+        decode_pcm16( channel + 2 * i, scales[block], run, out + ( i - first ) );
+        i += run;
+      }
+      return;
+
+    case SampleFormat::Float16:
+      decode_float16( channel + 2 * first, count, out );
+      return;
+  }
+
+  throw runtime_error( "unknown sample format " + to_string( int( format ) ) );
+}
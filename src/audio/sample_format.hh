@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* how WavWrapper keeps samples in memory (and in a sample bank) */
+enum class SampleFormat : uint8_t
+{
+  Float32, /* 4 bytes: 32-bit float, mixed in place */
+  PCM24,   /* 3 bytes: packed little-endian signed 24-bit, as recorded (lossless) */
+  PCM16,   /* 2 bytes: signed 16-bit, with one float scale per SCALE_BLOCK_FRAMES frames of each channel */
+  Float16  /* 2 bytes: IEEE half precision */
+};
+
+/* frames of one channel that share a PCM16 scale */
+constexpr size_t SCALE_BLOCK_FRAMES = 64;
+
+size_t bytes_per_sample( const SampleFormat format );
+
+std::string format_name( const SampleFormat format );
+SampleFormat parse_sample_format( const std::string& name ); /* "float32", "pcm24", "pcm16" or "float16" */
+
+/* Convert one channel of count samples to the stored format. For PCM16, count must be a multiple of
+   SCALE_BLOCK_FRAMES and scales receives count / SCALE_BLOCK_FRAMES entries; other formats ignore scales. */
+void encode_samples( const SampleFormat format,
+                     const float* samples,
+                     const size_t count,
+                     uint8_t* channel,
+                     float* scales );
+
+/* Convert samples [first, first + count) of one stored channel back to float, into out. Uses SSSE3/AVX2 shuffles
+   for PCM24, SSE4.1/AVX2 widening for PCM16 and F16C for Float16 when the compiler targets them; the scalar path
+   gives identical results. Reads only the requested samples. */
+void decode_samples( const SampleFormat format,
+                     const uint8_t* channel,
+                     const float* scales,
+                     const size_t first,
+                     const size_t count,
+                     float* out );
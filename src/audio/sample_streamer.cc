@@ -0,0 +1,230 @@
+#include "sample_streamer.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+SampleStreamer::SampleStreamer( const string& bank_filename, const size_t num_streams )
+  : bank_( CheckSystemCall( "open( \"" + bank_filename + "\" )", ::open( bank_filename.c_str(), O_RDONLY ) ) )
+  , streams_( num_streams )
+{
+  if ( num_streams == 0 or num_streams >= NO_STREAM ) {
+    throw runtime_error( "SampleStreamer: invalid number of streams " + to_string( num_streams ) );
+  }
+
+  for ( auto& stream : streams_ ) {
+    stream.left.resize( ring_frames );
+    stream.right.resize( ring_frames );
+  }
+
+  io_thread_ = thread( &SampleStreamer::io_loop, this );
+}
+
+SampleStreamer::~SampleStreamer()
+{
+  stop_ = true;
+  io_thread_.join();
+}
+
+uint32_t SampleStreamer::open( const WavWrapper& layer )
+{
+  if ( not layer.stream_source() ) {
+    return NO_STREAM;
+  }
+
+  for ( size_t tries = 0; tries < streams_.size(); tries++ ) {
+    const size_t i = next_free_;
+    next_free_ = ( next_free_ + 1 ) % streams_.size();
+
+    Stream& stream = streams_[i];
+    if ( stream.state.load( memory_order_acquire ) != State::Free ) {
+      continue;
+    }
+
+    stream.layer = &layer;
+    stream.read_frame.store( layer.resident_length(), memory_order_relaxed );
+    stream.write_frame.store( layer.resident_length(), memory_order_relaxed );
+    stream.state.store( State::Active, memory_order_release );
+    return i;
+  }
+
+  unstreamed_.fetch_add( 1, memory_order_relaxed );
+  return NO_STREAM;
+}
+
+void SampleStreamer::close( const uint32_t stream )
+{
+  if ( stream != NO_STREAM ) {
+    streams_[stream].state.store( State::Retired, memory_order_release );
+  }
+}
+
+wav_block_t SampleStreamer::read( const uint32_t stream,
+                                  const WavWrapper& layer,
+                                  const long first,
+                                  const size_t count,
+                                  float* left_scratch,
+                                  float* right_scratch )
+{
+  const long resident = layer.resident_length();
+  const long end = first + count;
+
+  if ( end <= resident ) {
+    return layer.read( first, count, left_scratch, right_scratch );
+  }
+
+  /* the part that's still resident */
+  size_t done = 0;
+  if ( first < resident ) {
+    done = resident - first;
+    const wav_block_t head = layer.read( first, done, left_scratch, right_scratch );
+    if ( head.left.data() != left_scratch ) {
+      copy_n( head.left.data(), done, left_scratch );
+      copy_n( head.right.data(), done, right_scratch );
+    }
+  }
+
+  /* then whatever the I/O thread has read of the rest */
+  const size_t from = first + done;
+  const size_t wanted_end = min( size_t( end ), layer.length() );
+  size_t available = from;
+
+  if ( stream != NO_STREAM ) {
+    Stream& s = streams_[stream];
+    s.read_frame.store( from, memory_order_release );
+    available = max( from, min( wanted_end, s.write_frame.load( memory_order_acquire ) ) );
+
+    for ( size_t frame = from; frame < available; ) {
+      const size_t slot = frame % ring_frames;
+      const size_t run = min( available - frame, ring_frames - slot );
+      copy_n( s.left.data() + slot, run, left_scratch + ( long( frame ) - first ) );
+      copy_n( s.right.data() + slot, run, right_scratch + ( long( frame ) - first ) );
+      frame += run;
+    }
+  }
+
+  if ( available < wanted_end and stream != NO_STREAM ) {
+    underruns_.fetch_add( 1, memory_order_relaxed );
+    underrun_frames_.fetch_add( wanted_end - available, memory_order_relaxed );
+  }
+
+  /* silence for anything missing, and past the end of the sample */
+  const size_t filled = long( available ) - first;
+  fill( left_scratch + filled, left_scratch + count, 0.0f );
+  fill( right_scratch + filled, right_scratch + count, 0.0f );
+
+  return { { left_scratch, count }, { right_scratch, count } };
+}
+
+void SampleStreamer::io_loop()
+{
+  vector<uint8_t> staging( ( chunk_frames + SCALE_BLOCK_FRAMES ) * sizeof( float ) );
+
+  try {
+    while ( not stop_ ) {
+      bool busy = false;
+
+      for ( auto& stream : streams_ ) {
+        switch ( stream.state.load( memory_order_acquire ) ) {
+          case State::Retired:
+            stream.state.store( State::Free, memory_order_release );
+            break;
+          case State::Active:
+            busy |= fill_ring( stream, staging );
+            break;
+          case State::Free:
+            break;
+        }
+      }
+
+      /* every ring is full (or its sample is finished): check again soon */
+      if ( not busy ) {
+        this_thread::sleep_for( chrono::milliseconds( 1 ) );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "SampleStreamer: " << e.what() << "\n";
+    failed_ = true;
+  }
+}
+
+bool SampleStreamer::fill_ring( Stream& stream, vector<uint8_t>& staging )
+{
+  const WavWrapper& layer = *stream.layer;
+  const StreamSource& source = *layer.stream_source();
+
+  const size_t write_frame = stream.write_frame.load( memory_order_relaxed );
+  const size_t limit = min( stream.read_frame.load( memory_order_acquire ) + ring_frames, layer.length() );
+  if ( write_frame >= limit ) {
+    return false;
+  }
+
+  const size_t count = min( { chunk_frames, limit - write_frame, ring_frames - write_frame % ring_frames } );
+
+  /* read from the start of a scale block, so PCM16 samples line up with their scales */
+  const SampleFormat format = layer.format();
+  const size_t bps = bytes_per_sample( format );
+  const size_t start = WavWrapper::lead_frames + write_frame;
+  const size_t aligned_start = start / SCALE_BLOCK_FRAMES * SCALE_BLOCK_FRAMES;
+  const size_t length = ( start - aligned_start + count ) * bps;
+
+  for ( size_t num = 0; num < 2; num++ ) {
+    const uint64_t offset = source.offset + ( num * source.stride + aligned_start ) * bps;
+    for ( size_t done = 0; done < length; ) {
+      const ssize_t bytes
+        = CheckSystemCall( "pread", pread( bank_.fd_num(), staging.data() + done, length - done, offset + done ) );
+      if ( bytes == 0 ) {
+        throw runtime_error( "sample bank ended unexpectedly" );
+      }
+      done += bytes;
+    }
+
+    const float* scales = format == SampleFormat::PCM16
+                            ? source.scales.data() + num * ( source.stride / SCALE_BLOCK_FRAMES )
+                                + aligned_start / SCALE_BLOCK_FRAMES
+                            : nullptr;
+    float* ring = ( num == 0 ? stream.left : stream.right ).data() + write_frame % ring_frames;
+    decode_samples( format, staging.data(), scales, start - aligned_start, count, ring );
+  }
+
+  bytes_read_.fetch_add( 2 * length, memory_order_relaxed );
+  stream.write_frame.store( write_frame + count, memory_order_release );
+  return true;
+}
+
+void SampleStreamer::summary( ostream& out ) const
+{
+  size_t active = 0;
+  for ( const auto& stream : streams_ ) {
+    active += stream.state.load( memory_order_relaxed ) == State::Active;
+  }
+
+  out << "sample streaming:";
+  out << " active streams=" << active << "/" << streams_.size();
+  out << " read=" << bytes_read_.load( memory_order_relaxed ) / 1024 << " KiB";
+  out << " underruns=" << underruns_.load( memory_order_relaxed );
+  out << " (" << underrun_frames_.load( memory_order_relaxed ) << " frames)";
+
+  if ( unstreamed_.load( memory_order_relaxed ) ) {
+    out << " unstreamed layers=" << unstreamed_.load( memory_order_relaxed );
+  }
+
+  if ( failed_ ) {
+    out << " STOPPED after I/O error";
+  }
+
+  out << "\n";
+}
+
+void SampleStreamer::reset_summary()
+{
+  underruns_ = 0;
+  underrun_frames_ = 0;
+  unstreamed_ = 0;
+  bytes_read_ = 0;
+}
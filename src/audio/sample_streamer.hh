@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "summarize.hh"
+#include "wav_wrapper.hh"
+
+/* Reads the tails of partly-resident samples (see WavWrapper::stream_source()) from the sample bank, ahead of the
+   voices playing them. The audio thread opens a stream per streamed layer at note-on and closes it when the voice
+   ends; a background I/O thread keeps each open stream's ring filled up to ring_frames past where it is being
+   read. Memory use is num_streams rings, regardless of the size of the sample library. */
+class SampleStreamer : public Summarizable
+{
+public:
+  static constexpr uint32_t NO_STREAM = std::numeric_limits<uint32_t>::max();
+  static constexpr size_t ring_frames = 4096;  /* per stream: about 85 ms at 48 kHz */
+  static constexpr size_t chunk_frames = 1024; /* most the I/O thread reads at once */
+
+private:
+  /* Free streams belong to the audio thread, Active ones are filled by the I/O thread, and Retired ones are
+     returned to Free by the I/O thread once it is sure not to be touching them */
+  enum class State : uint8_t
+  {
+    Free,
+    Active,
+    Retired
+  };
+
+  struct Stream
+  {
+    std::atomic<State> state { State::Free };
+    const WavWrapper* layer = nullptr;        /* set while Free, published by the switch to Active */
+    std::atomic<size_t> read_frame { 0 };     /* frames before this have been consumed */
+    std::atomic<size_t> write_frame { 0 };    /* frames before this are in the ring */
+    std::vector<float> left {}, right {};     /* ring_frames each, indexed by frame % ring_frames */
+  };
+
+  FileDescriptor bank_;
+  std::vector<Stream> streams_;
+  size_t next_free_ = 0; /* where the audio thread starts looking for a free stream */
+
+  std::atomic<bool> stop_ { false };
+  std::atomic<bool> failed_ { false };
+
+  /* since the last summary */
+  std::atomic<uint64_t> underruns_ { 0 };       /* reads that found frames missing */
+  std::atomic<uint64_t> underrun_frames_ { 0 }; /* frames played as silence because they hadn't arrived */
+  std::atomic<uint64_t> unstreamed_ { 0 };      /* layers that got no stream because all were open */
+  std::atomic<uint64_t> bytes_read_ { 0 };
+
+  std::thread io_thread_ {};
+
+  void io_loop();
+  bool fill_ring( Stream& stream, std::vector<uint8_t>& staging );
+
+public:
+  SampleStreamer( const std::string& bank_filename, const size_t num_streams );
+  ~SampleStreamer();
+
+  /* audio thread: start streaming layer from the end of its resident frames (NO_STREAM if it isn't streamed) */
+  uint32_t open( const WavWrapper& layer );
+  void close( const uint32_t stream );
+
+  /* audio thread: like WavWrapper::read(), but past the resident frames the samples come from the stream's ring
+     (or are silent, and counted as an underrun, if they haven't been read in time). Frames before first are
+     released for reuse, so first must never go backwards. */
+  wav_block_t read( const uint32_t stream,
+                    const WavWrapper& layer,
+                    const long first,
+                    const size_t count,
+                    float* left_scratch,
+                    float* right_scratch );
+
+  void summary( std::ostream& out ) const override;
+  void reset_summary() override;
+
+  /* can't copy or assign */
+  SampleStreamer( const SampleStreamer& other ) = delete;
+  SampleStreamer& operator=( const SampleStreamer& other ) = delete;
+};
@@ -1,6 +1,10 @@
 #include "synthesizer.hh"
+#include "mix_kernel.hh"
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <optional>
 
 constexpr unsigned int NUM_KEYS = 88;
 constexpr unsigned int KEY_OFFSET = 21;
@@ -8,20 +12,46 @@ constexpr unsigned int KEY_OFFSET = 21;
 constexpr unsigned int KEY_DOWN = 144;
 constexpr unsigned int KEY_UP = 128;
 constexpr unsigned int SUSTAIN = 176;
+constexpr unsigned int SUSTAIN_PEDAL = 64; /* controller number */
+
+constexpr float PRESS_GAIN = 0.2;                     /* to avoid clipping */
+const float RELEASE_GAIN = exp10( -37 / 20.0 ) * 0.2; /* to avoid clipping */
+constexpr float GAIN_DECAY = 0.0001 * PRESS_GAIN;     /* per frame, once a key is up and the pedal is not down */
+
+constexpr size_t retiring_streams = 64; /* spare streams, since closed ones take up to a millisecond to free up */
+constexpr size_t max_scheduled_events = 4096;
 
 using namespace std;
 
-Synthesizer::Synthesizer( const string& sample_directory )
-  : note_repo( sample_directory )
+Synthesizer::Synthesizer( const string& sample_directory,
+                          const size_t max_voices,
+                          const StealPolicy steal_policy,
+                          const SampleFormat sample_format,
+                          const unsigned int resident_ms )
+  : note_repo( sample_directory, sample_format, resident_ms )
+  , streamer_( note_repo.streaming()
+                 ? make_shared<SampleStreamer>( note_repo.streamed_bank(), 2 * max_voices + retiring_streams )
+                 : nullptr )
+  , voices( max_voices, steal_policy, streamer_.get() )
+  , left_scratch_( WavWrapper::padding_frames )
+  , right_scratch_( WavWrapper::padding_frames )
+  , schedule_( make_shared<EventSchedule>( max_scheduled_events ) )
 {
-  for ( size_t i = 0; i < NUM_KEYS; i++ ) {
-    keys.push_back( { {}, {} } );
-  }
 }
 
 void Synthesizer::process_new_data( uint8_t event_type, uint8_t event_note, uint8_t event_velocity )
 {
-  if ( event_type == SUSTAIN ) {
+  /* any channel will do */
+  if ( event_type < 0xf0 ) {
+    event_type &= 0xf0;
+  }
+
+  /* a note-on with zero velocity is a note-off (usually sent that way to make the most of running status) */
+  if ( event_type == KEY_DOWN and event_velocity == 0 ) {
+    event_type = KEY_UP;
+  }
+
+  if ( event_type == SUSTAIN and event_note == SUSTAIN_PEDAL ) {
     // std::cerr << (size_t) midi_processor.get_event_type() << " " << (size_t) event_note << " " <<
     // (size_t)event_velocity << "\n";
     if ( event_velocity == 127 )
@@ -30,87 +60,233 @@ void Synthesizer::process_new_data( uint8_t event_type, uint8_t event_note, uint
       sustain_down = false;
   } else if ( event_type == KEY_DOWN || event_type == KEY_UP ) {
     bool direction = event_type == KEY_DOWN ? true : false;
-    auto& k = keys.at( event_note - KEY_OFFSET );
+    const uint8_t key = event_note - KEY_OFFSET;
+
+    if ( key >= NUM_KEYS ) {
+      /* valid MIDI, but no key plays it: drop it rather than stop the audio */
+      schedule_->count_off_keyboard();
+      return;
+    }
 
     if ( !direction ) {
-      k.releases.push_back( { 0, event_velocity, 1.0, false } );
-      k.presses.back().released = true;
+      voices.add( key, false, note_repo.layers( false, key, event_velocity ), RELEASE_GAIN );
+
+      /* the most recent press of this key (the one with the smallest position) is the one coming up */
+      optional<size_t> newest_press;
+      for ( size_t i = 0; i < voices.size(); i++ ) {
+        if ( voices.key[i] == key and voices.direction[i] and not voices.released[i]
+             and ( not newest_press.has_value() or voices.position[i] < voices.position[newest_press.value()] ) ) {
+          newest_press = i;
+        }
+      }
+
+      if ( newest_press.has_value() ) {
+        voices.released[newest_press.value()] = true;
+      }
     } else {
-      k.presses.push_back( { 0, event_velocity, 1.0, false } );
+      voices.add( key, true, note_repo.layers( true, key, event_velocity ), PRESS_GAIN );
     }
   }
 }
 
-wav_frame_t Synthesizer::calculate_curr_sample() const
+void Synthesizer::schedule( const size_t sample, const MidiEvent& event )
 {
-  std::pair<float, float> total_sample = { 0, 0 };
+  if ( not schedule_->add( sample, event ) ) {
+    /* schedule is full: better late than never */
+    process_new_data( event.type, event.note, event.velocity );
+  }
+}
 
-  for ( size_t i = 0; i < NUM_KEYS; i++ ) {
-    auto& k = keys.at( i );
-    size_t active_presses = k.presses.size();
-    size_t active_releases = k.releases.size();
+bool Synthesizer::voice_finished( const size_t i ) const
+{
+  return voices.layers[i].at_end( voices.position[i] );
+}
 
-    for ( size_t j = 0; j < active_presses; j++ ) {
-      // auto t1 = high_resolution_clock::now();
-      float amplitude_multiplier = k.presses.at( j ).vol_ratio * 0.2; /* to avoid clipping */
+/* Mix count frames of one layer, read from position onwards at rate, into left and right. Layers not stored as
+   Float32 (or not resident) are copied into the scratch buffers first, which need room for count * rate + 2 *
+   INTERPOLATION_REACH + 2 frames. Reading past the end of a layer picks up its zero padding, so there's no
+   per-frame end check. */
+static void mix_from_layer( const WavWrapper& layer,
+                            SampleStreamer* streamer,
+                            const uint32_t stream,
+                            const Interpolation interpolation,
+                            const double position,
+                            const double rate,
+                            const size_t count,
+                            const float layer_gain,
+                            const float gain,
+                            const float gain_step,
+                            float* left,
+                            float* right,
+                            float* left_scratch,
+                            float* right_scratch )
+{
+  if ( position >= layer.length() ) {
+    return;
+  }
 
-      const std::pair<float, float> curr_sample
-        = note_repo.get_sample( true, i, k.presses.at( j ).velocity, k.presses.at( j ).offset );
+  auto read = [&]( const long first, const size_t frames ) {
+    return layer.stream_source() ? streamer->read( stream, layer, first, frames, left_scratch, right_scratch )
+                                 : layer.read( first, frames, left_scratch, right_scratch );
+  };
 
-      total_sample.first += curr_sample.first * amplitude_multiplier;
-      total_sample.second += curr_sample.second * amplitude_multiplier;
-      // auto t2 = high_resolution_clock::now();
-      // if (frames_processed % 50000 == 0) std::cerr << "Time to get one key press sample: " <<
-      // duration_cast<nanoseconds>(t2 - t1).count() << "\n";
-    }
+  if ( rate == 1 ) {
+    /* played at its recorded pitch, so position stays a whole number of frames */
+    const wav_block_t src = read( position, count );
+    mix_layer( src.left.data(), src.right.data(), count, layer_gain, gain, gain_step, left, right );
+    return;
+  }
+
+  /* every frame the interpolator can touch, plus one in case of rounding */
+  const long base = floor( position );
+  const long first = base - INTERPOLATION_REACH;
+  const long end = long( floor( position + ( count - 1 ) * rate ) ) + INTERPOLATION_REACH + 2;
+  const wav_block_t src = read( first, end - first );
+
+  mix_layer_resampled( interpolation,
+                       src.left.data() + INTERPOLATION_REACH,
+                       src.right.data() + INTERPOLATION_REACH,
+                       position - base,
+                       rate,
+                       count,
+                       layer_gain,
+                       gain,
+                       gain_step,
+                       left,
+                       right );
+}
 
-    for ( size_t j = 0; j < active_releases; j++ ) {
-      // auto t1 = high_resolution_clock::now();
+wav_frame_t Synthesizer::calculate_curr_sample() const
+{
+  float left = 0, right = 0;
+  array<float, 2 * INTERPOLATION_REACH + 4> left_scratch, right_scratch;
 
-      float amplitude_multiplier = exp10( -37 / 20.0 ) * 0.2; /* to avoid clipping */
+  for ( size_t i = 0; i < voices.size(); i++ ) {
+    const LayerMix& layers = voices.layers[i];
 
-      const std::pair<float, float> curr_sample
-        = note_repo.get_sample( false, i, k.releases.at( j ).velocity, k.releases.at( j ).offset );
+    auto mix = [&]( const WavWrapper& layer, const uint32_t stream, const float layer_gain ) {
+      mix_from_layer( layer,
+                      streamer_.get(),
+                      stream,
+                      interpolation_,
+                      voices.position[i],
+                      layers.rate,
+                      1,
+                      layer_gain,
+                      voices.gain[i],
+                      0,
+                      &left,
+                      &right,
+                      left_scratch.data(),
+                      right_scratch.data() );
+    };
 
-      total_sample.first += curr_sample.first * amplitude_multiplier;
-      total_sample.second += curr_sample.second * amplitude_multiplier;
-      // auto t2 = high_resolution_clock::now();
-      // if (frames_processed % 50000 == 0) std::cerr << "Time to get one key release sample: " <<
-      // duration_cast<nanoseconds>(t2 - t1).count() << "\n";
+    mix( *layers.first, voices.streams[i][0], layers.first_gain );
+    if ( layers.second_gain != 0 ) {
+      mix( *layers.second, voices.streams[i][1], layers.second_gain );
     }
   }
 
-  return total_sample;
+  return { left, right };
 }
 
 void Synthesizer::advance_sample()
 {
   frames_processed++;
-  for ( size_t i = 0; i < NUM_KEYS; i++ ) {
-    auto& k = keys.at( i );
-    size_t active_presses = k.presses.size();
-    size_t active_releases = k.releases.size();
-
-    for ( size_t j = 0; j < active_presses; j++ ) {
-      k.presses.at( j ).offset++;
-
-      if ( note_repo.note_finished( true, i, k.presses.at( j ).velocity, k.presses.at( j ).offset ) ) {
-        k.presses.erase( k.presses.begin() );
-        j--;
-        active_presses--;
-      } else if ( ( k.presses.at( j ).released && !sustain_down ) & ( k.presses.at( j ).vol_ratio > 0 ) ) {
-        k.presses.at( j ).vol_ratio -= 0.0001;
-      }
+
+  for ( size_t i = 0; i < voices.size(); ) {
+    voices.position[i] += voices.layers[i].rate;
+
+    if ( voice_finished( i ) ) {
+      voices.remove( i );
+      continue;
     }
 
-    for ( size_t j = 0; j < active_releases; j++ ) {
-      k.releases.at( j ).offset++;
+    if ( voices.released[i] and not sustain_down ) {
+      voices.gain[i] = max( voices.gain[i] - GAIN_DECAY, 0.0f );
+    }
+
+    i++;
+  }
+}
+
+void Synthesizer::render( const size_t first_sample, span<float> left, span<float> right )
+{
+  if ( first_sample != frames_processed ) {
+    throw runtime_error( "Synthesizer::render: asked for sample " + to_string( first_sample ) + " but next is "
+                         + to_string( frames_processed ) );
+  }
 
-      if ( note_repo.note_finished( false, i, k.releases.at( j ).velocity, k.releases.at( j ).offset ) ) {
-        k.releases.erase( k.releases.begin() );
-        j--;
-        active_releases--;
+  if ( left.size() != right.size() ) {
+    throw runtime_error( "Synthesizer::render: left and right channels differ in length" );
+  }
+
+  /* sample layers are zero-padded by WavWrapper::padding_frames, so keep each pass short enough that a voice
+     playing faster than 1:1 (plus the interpolator's reach) stays inside the padding */
+  constexpr size_t max_pass = WavWrapper::padding_frames / 2;
+  for ( size_t pos = 0; pos < left.size(); ) {
+    /* apply the events that are due, and stop the pass where the next one is */
+    size_t count = min( max_pass, left.size() - pos );
+    for ( auto next = schedule_->next_sample(); next.has_value(); next = schedule_->next_sample() ) {
+      if ( next.value() > frames_processed ) {
+        count = min( count, next.value() - frames_processed );
+        break;
       }
+
+      const MidiEvent event = schedule_->pop( frames_processed );
+      process_new_data( event.type, event.note, event.velocity );
     }
+
+    render_block( left.mutable_data() + pos, right.mutable_data() + pos, count );
+    pos += count;
   }
 }
+
+void Synthesizer::render_block( float* left, float* right, const size_t count )
+{
+  fill( left, left + count, 0 );
+  fill( right, right + count, 0 );
+
+  /* voice-major order: look up each voice once per block, then mix its frames with the vector kernel */
+  for ( size_t i = 0; i < voices.size(); ) {
+    const LayerMix& layers = voices.layers[i];
+    const double position = voices.position[i];
+    const float gain = voices.gain[i];
+    const float gain_step = ( voices.released[i] and not sustain_down ) ? GAIN_DECAY : 0;
+
+    auto mix = [&]( const WavWrapper& layer, const uint32_t stream, const float layer_gain ) {
+      mix_from_layer( layer,
+                      streamer_.get(),
+                      stream,
+                      interpolation_,
+                      position,
+                      layers.rate,
+                      count,
+                      layer_gain,
+                      gain,
+                      gain_step,
+                      left,
+                      right,
+                      left_scratch_.data(),
+                      right_scratch_.data() );
+    };
+
+    mix( *layers.first, voices.streams[i][0], layers.first_gain );
+    if ( layers.second_gain != 0 ) {
+      mix( *layers.second, voices.streams[i][1], layers.second_gain );
+    }
+
+    voices.position[i] = position + count * layers.rate;
+    voices.gain[i] = max( gain - count * gain_step, 0.0f );
+
+    /* retire voices that ran off the end of their samples during this block */
+    if ( voice_finished( i ) ) {
+      voices.remove( i );
+      continue;
+    }
+
+    i++;
+  }
+
+  frames_processed += count;
+}
@@ -1,37 +1,61 @@
 #pragma once
 
+#include <memory>
+
+#include "event_schedule.hh"
 #include "midi_processor.hh"
+#include "mix_kernel.hh"
 #include "note_repository.hh"
-//#include <deque>
-#include <vector>
+#include "spans.hh"
+#include "voice_pool.hh"
 
 class Synthesizer
 {
-  struct sound
-  {
-    unsigned long offset;
-    unsigned long velocity;
-    float vol_ratio;
-    bool released = false;
-  };
-
-  struct key
-  {
-    std::vector<sound> presses;
-    std::vector<sound> releases;
-  };
-
   NoteRepository note_repo;
-  std::vector<key> keys {};
+  std::shared_ptr<SampleStreamer> streamer_; /* reads sample tails from disk, if they aren't all resident */
+  VoicePool voices;
   bool sustain_down = false;
   size_t frames_processed = 0;
+  Interpolation interpolation_ = Interpolation::Cubic; /* for keys played from a neighbouring note's samples */
+  std::vector<float> left_scratch_, right_scratch_;     /* samples converted or streamed for mixing */
+  std::shared_ptr<EventSchedule> schedule_;             /* events to apply at a given output sample */
+
+  bool voice_finished( const size_t i ) const;
+
+  void render_block( float* left, float* right, const size_t count );
 
 public:
-  Synthesizer( const std::string& sample_directory );
+  using StealPolicy = VoicePool::StealPolicy;
+
+  Synthesizer( const std::string& sample_directory,
+               const size_t max_voices = 256,
+               const StealPolicy steal_policy = StealPolicy::Oldest,
+               const SampleFormat sample_format = SampleFormat::Float32,
+               const unsigned int resident_ms = 0 ); /* nonzero: keep this much of each sample, stream the rest */
 
+  /* apply an event now, i.e. from the next sample rendered */
   void process_new_data( uint8_t event_type, uint8_t event_note, uint8_t event_velocity );
 
+  /* apply an event at a given output sample: render() splits its blocks there (or applies it at the start of the
+     next block, and counts it as late, if that sample has already been rendered) */
+  void schedule( const size_t sample, const MidiEvent& event );
+
   wav_frame_t calculate_curr_sample() const;
 
   void advance_sample();
+
+  /* fill left and right with the next block of output (starting at first_sample), and advance past it */
+  void render( const size_t first_sample, span<float> left, span<float> right );
+
+  void set_interpolation( const Interpolation interpolation ) { interpolation_ = interpolation; }
+
+  size_t frames_processed_count() const { return frames_processed; }
+  size_t active_voices() const { return voices.size(); }
+  unsigned int voices_stolen() const { return voices.steals(); }
+
+  /* underrun statistics for the stats printer (null unless streaming) */
+  std::shared_ptr<SampleStreamer> streamer() const { return streamer_; }
+
+  /* scheduled-event statistics for the stats printer */
+  std::shared_ptr<EventSchedule> event_schedule() const { return schedule_; }
 };
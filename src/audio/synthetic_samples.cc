@@ -0,0 +1,61 @@
+#include "synthetic_samples.hh"
+#include "exception.hh"
+#include "note_repository.hh"
+
+#include <cmath>
+#include <sndfile.hh>
+#include <unistd.h>
+
+using namespace std;
+
+static constexpr unsigned int SAMPLE_RATE = 48000; /* Hz */
+
+static void write_tone( const string& filename, const double frequency, const double seconds )
+{
+  SndfileHandle file { filename, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_24, 2, SAMPLE_RATE };
+  if ( file.error() ) {
+    throw runtime_error( filename + ": " + file.strError() );
+  }
+
+  /* a few decaying harmonics, slightly different in each ear */
+  const size_t frames = lrint( seconds * SAMPLE_RATE );
+  vector<float> interleaved( 2 * frames );
+  for ( size_t i = 0; i < frames; i++ ) {
+    const double t = double( i ) / SAMPLE_RATE;
+    double value = 0;
+    for ( unsigned int harmonic = 1; harmonic <= 4; harmonic++ ) {
+      value += sin( 2 * M_PI * frequency * harmonic * t ) * exp( -3.0 * harmonic * t ) / ( 2 * harmonic );
+    }
+    interleaved[2 * i] = value;
+    interleaved[2 * i + 1] = 0.9 * value;
+  }
+
+  if ( file.writef( interleaved.data(), frames ) != sf_count_t( frames ) ) {
+    throw runtime_error( filename + ": " + file.strError() );
+  }
+}
+
+SyntheticSamples::SyntheticSamples( const double press_seconds, const double release_seconds )
+  : directory_( [] {
+    string name_template = "/tmp/pancake-samples.XXXXXX";
+    if ( not mkdtemp( name_template.data() ) ) {
+      throw unix_error( "mkdtemp" );
+    }
+    return name_template + "/";
+  }() )
+  , filenames_( NoteRepository::sample_filenames() )
+{
+  for ( size_t i = 0; i < filenames_.size(); i++ ) {
+    const bool release = filenames_[i].substr( 0, 3 ) == "rel";
+    const double frequency = 55.0 * pow( 2.0, ( i % 72 ) / 12.0 );
+    write_tone( directory_ + filenames_[i], frequency, release ? release_seconds : press_seconds );
+  }
+}
+
+SyntheticSamples::~SyntheticSamples()
+{
+  for ( const auto& filename : filenames_ ) {
+    unlink( ( directory_ + filename ).c_str() );
+  }
+  rmdir( directory_.c_str() );
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* A directory of generated samples, with the names and format NoteRepository expects (a few decaying harmonics
+   per note, at 48 kHz), removed when this goes away. For benchmarks and tests that have no sample library. */
+class SyntheticSamples
+{
+  std::string directory_;
+  std::vector<std::string> filenames_;
+
+public:
+  /* lengths, in seconds, of the velocity layers and of the release samples */
+  SyntheticSamples( const double press_seconds, const double release_seconds );
+  ~SyntheticSamples();
+
+  /* with a trailing slash, ready for Synthesizer */
+  const std::string& directory() const { return directory_; }
+
+  /* can't copy or assign */
+  SyntheticSamples( const SyntheticSamples& other ) = delete;
+  SyntheticSamples& operator=( const SyntheticSamples& other ) = delete;
+};
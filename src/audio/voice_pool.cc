@@ -0,0 +1,96 @@
+#include "voice_pool.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+VoicePool::VoicePool( const size_t capacity, const StealPolicy policy, SampleStreamer* streamer )
+  : policy_( policy )
+  , streamer_( streamer )
+  , key( capacity )
+  , direction( capacity )
+  , layers( capacity )
+  , position( capacity )
+  , gain( capacity )
+  , released( capacity )
+  , streams( capacity )
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "VoicePool: capacity must be nonzero" );
+  }
+}
+
+size_t VoicePool::victim( const uint8_t new_key ) const
+{
+  size_t oldest = 0, oldest_same_key = size_, quietest = 0;
+
+  for ( size_t i = 0; i < size_; i++ ) {
+    if ( position[i] > position[oldest] ) {
+      oldest = i;
+    }
+
+    if ( gain[i] < gain[quietest] ) {
+      quietest = i;
+    }
+
+    if ( key[i] == new_key and ( oldest_same_key == size_ or position[i] > position[oldest_same_key] ) ) {
+      oldest_same_key = i;
+    }
+  }
+
+  switch ( policy_ ) {
+    case StealPolicy::Quietest:
+      return quietest;
+    case StealPolicy::SameKey:
+      return oldest_same_key < size_ ? oldest_same_key : oldest;
+    case StealPolicy::Oldest:
+      break;
+  }
+
+  return oldest;
+}
+
+void VoicePool::add( const uint8_t s_key, const bool s_direction, const LayerMix& s_layers, const float s_gain )
+{
+  if ( size_ == capacity() ) {
+    remove( victim( s_key ) );
+    steals_++;
+  }
+
+  key[size_] = s_key;
+  direction[size_] = s_direction;
+  layers[size_] = s_layers;
+  position[size_] = 0;
+  gain[size_] = s_gain;
+  released[size_] = false;
+  streams[size_] = { SampleStreamer::NO_STREAM, SampleStreamer::NO_STREAM };
+
+  if ( streamer_ ) {
+    streams[size_][0] = streamer_->open( *s_layers.first );
+    if ( s_layers.second_gain != 0 ) {
+      streams[size_][1] = streamer_->open( *s_layers.second );
+    }
+  }
+
+  size_++;
+}
+
+void VoicePool::remove( const size_t i )
+{
+  const size_t last = size_ - 1;
+
+  if ( streamer_ ) {
+    streamer_->close( streams[i][0] );
+    streamer_->close( streams[i][1] );
+  }
+
+  key[i] = key[last];
+  direction[i] = direction[last];
+  layers[i] = layers[last];
+  position[i] = position[last];
+  gain[i] = gain[last];
+  released[i] = released[last];
+  streams[i] = streams[last];
+
+  size_--;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "note_repository.hh"
+#include "sample_streamer.hh"
+
+/* the voices that are currently sounding, kept as parallel arrays so the render loop walks contiguous memory */
+/* storage is allocated once, at construction; adding a voice to a full pool steals an existing one */
+class VoicePool
+{
+public:
+  enum class StealPolicy
+  {
+    Oldest,   /* the voice that has played the longest */
+    Quietest, /* the voice with the smallest gain */
+    SameKey   /* the oldest voice on the key being struck, else the oldest overall */
+  };
+
+private:
+  size_t size_ = 0;
+  StealPolicy policy_;
+  SampleStreamer* streamer_; /* opens and closes the streams of partly-resident layers (if any) */
+  unsigned int steals_ = 0;
+
+  size_t victim( const uint8_t new_key ) const;
+
+public:
+  std::vector<uint8_t> key {};       /* 0..87 */
+  std::vector<uint8_t> direction {}; /* 1 = press (velocity layers), 0 = release sample */
+  std::vector<LayerMix> layers {};   /* sample layer(s) chosen by the velocity of the triggering event */
+  std::vector<double> position {};   /* next (fractional) frame to read from the sample */
+  std::vector<float> gain {};        /* current amplitude multiplier */
+  std::vector<uint8_t> released {};  /* press voice whose key has come back up */
+
+  /* the streams reading layers.first and layers.second, or SampleStreamer::NO_STREAM */
+  std::vector<std::array<uint32_t, 2>> streams {};
+
+  VoicePool( const size_t capacity, const StealPolicy policy, SampleStreamer* streamer = nullptr );
+
+  size_t capacity() const { return key.size(); }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  unsigned int steals() const { return steals_; }
+
+  void add( const uint8_t s_key, const bool s_direction, const LayerMix& s_layers, const float s_gain );
+
+  /* O(1): move the last voice into slot i. The caller must not advance past i afterwards. */
+  void remove( const size_t i );
+
+  /* can't copy or assign (each voice's streams belong to it alone) */
+  VoicePool( const VoicePool& other ) = delete;
+  VoicePool& operator=( const VoicePool& other ) = delete;
+};
@@ -2,7 +2,6 @@
 #include "exception.hh"
 
 #include <iostream>
-#include <samplerate.h>
 
 #include <fstream>
 
@@ -13,12 +12,13 @@ constexpr unsigned int NUM_CHANNELS = 2;
 
 using namespace std;
 
-WavWrapper::WavWrapper( const string& filename )
+WavWrapper::WavWrapper( const string& filename, const SampleFormat format )
+  : format_( format )
 {
   SndfileHandle handle_ { filename };
 
   const unsigned int num_frames_in_input = handle_.frames();
-  samples_.resize( NUM_CHANNELS * num_frames_in_input );
+  vector<float> samples( NUM_CHANNELS * num_frames_in_input );
 
   if ( handle_.error() ) {
     throw runtime_error( filename + ": " + handle_.strError() );
@@ -39,7 +39,7 @@ WavWrapper::WavWrapper( const string& filename )
   }
 
   /* read file into memory */
-  const auto retval = handle_.read( samples_.data(), NUM_CHANNELS * num_frames_in_input );
+  const auto retval = handle_.read( samples.data(), NUM_CHANNELS * num_frames_in_input );
 
   if ( retval != NUM_CHANNELS * num_frames_in_input ) {
     throw runtime_error( "unexpected read of " + to_string( retval ) + " samples" );
@@ -50,11 +50,111 @@ WavWrapper::WavWrapper( const string& filename )
   if ( 0 != handle_.read( &dummy, 1 ) ) {
     throw runtime_error( "unexpected extra data in WAV file" );
   }
+
+  store_interleaved( samples );
+}
+
+WavWrapper::WavWrapper( const uint8_t* storage,
+                        const SampleFormat format,
+                        const size_t length,
+                        const size_t stride )
+  : data_( storage )
+  , format_( format )
+  , length_( length )
+  , stride_( stride )
+  , resident_length_( length )
+{
+  if ( stride_ < padded_length( length_ ) or stride_ % 64 ) {
+    throw runtime_error( "WavWrapper: stride " + to_string( stride_ ) + " leaves no room for padding" );
+  }
+
+  if ( reinterpret_cast<uintptr_t>( storage ) % 64 ) {
+    throw runtime_error( "WavWrapper: samples are not 64-byte aligned" );
+  }
+}
+
+WavWrapper::WavWrapper( const WavWrapper& whole, const size_t resident_frames, const uint64_t bank_offset )
+  : format_( whole.format_ )
+  , length_( whole.length_ )
+  , resident_length_( min( resident_frames, whole.length_ ) )
+{
+  if ( resident_length_ < length_ ) {
+    stream_ = StreamSource { bank_offset, whole.stride_ };
+    if ( format_ == SampleFormat::PCM16 ) {
+      const size_t blocks = whole.stride_ / SCALE_BLOCK_FRAMES;
+      stream_->scales.assign( whole.scales( 0 ), whole.scales( 0 ) + NUM_CHANNELS * blocks );
+    }
+  }
+
+  stride_ = padded_length( resident_length_ );
+
+  const size_t size = storage_size( format_, stride_ );
+  storage_.reset(
+    notnull( "aligned_alloc", static_cast<uint8_t*>( aligned_alloc( 64, ( size + 63 ) / 64 * 64 ) ) ) );
+  fill( storage_.get(), storage_.get() + size, 0 );
+  data_ = storage_.get();
+
+  /* the leading zeros and resident frames of each channel (and their scales); the rest stays zero */
+  const size_t bps = bytes_per_sample( format_ );
+  for ( size_t num = 0; num < NUM_CHANNELS; num++ ) {
+    copy_n( whole.channel( num ), ( lead_frames + resident_length_ ) * bps, storage_.get() + num * stride_ * bps );
+    if ( format_ == SampleFormat::PCM16 ) {
+      copy_n( whole.scales( num ), stride_ / SCALE_BLOCK_FRAMES, const_cast<float*>( scales( num ) ) );
+    }
+  }
+}
+
+size_t WavWrapper::padded_length( const size_t length )
+{
+  /* a multiple of 64 samples is a multiple of 64 bytes in every format (and of SCALE_BLOCK_FRAMES) */
+  return ( lead_frames + length + padding_frames + 63 ) / 64 * 64;
+}
+
+size_t WavWrapper::storage_size( const SampleFormat format, const size_t stride )
+{
+  const size_t scale_bytes
+    = format == SampleFormat::PCM16 ? NUM_CHANNELS * ( stride / SCALE_BLOCK_FRAMES ) * sizeof( float ) : 0;
+  return NUM_CHANNELS * stride * bytes_per_sample( format ) + scale_bytes;
+}
+
+const float* WavWrapper::scales( const size_t num ) const
+{
+  if ( format_ != SampleFormat::PCM16 ) {
+    return nullptr;
+  }
+
+  return reinterpret_cast<const float*>( channel( NUM_CHANNELS ) ) + num * ( stride_ / SCALE_BLOCK_FRAMES );
+}
+
+void WavWrapper::store_interleaved( const vector<float>& samples )
+{
+  length_ = samples.size() / NUM_CHANNELS;
+  resident_length_ = length_;
+  stride_ = padded_length( length_ );
+
+  const size_t size = storage_size( format_, stride_ );
+  storage_.reset(
+    notnull( "aligned_alloc", static_cast<uint8_t*>( aligned_alloc( 64, ( size + 63 ) / 64 * 64 ) ) ) );
+  data_ = storage_.get();
+
+  vector<float> planar( stride_ );
+  for ( size_t num = 0; num < NUM_CHANNELS; num++ ) {
+    fill( planar.begin(), planar.end(), 0.0f );
+    for ( size_t i = 0; i < length_; i++ ) {
+      planar[lead_frames + i] = samples[NUM_CHANNELS * i + num];
+    }
+
+    encode_samples( format_,
+                    planar.data(),
+                    stride_,
+                    storage_.get() + num * stride_ * bytes_per_sample( format_ ),
+                    const_cast<float*>( scales( num ) ) );
+  }
 }
 
 bool WavWrapper::at_end( size_t offset ) const
 {
-  if ( offset >= samples_.size() / 2 ) {
+  if ( offset >= length_ ) {
     return true;
   }
 
@@ -66,29 +166,30 @@ wav_frame_t WavWrapper::view( size_t offset ) const
   if ( at_end( offset ) ) {
     return { 0, 0 };
   }
-  std::pair<float, float> sample = { samples_.at( offset * 2 ), samples_.at( ( offset * 2 ) + 1 ) };
 
-  return sample;
+  float left, right;
+  const wav_block_t frame = read( offset, 1, &left, &right );
+  return { frame.left[0], frame.right[0] };
 }
 
-void WavWrapper::bend_pitch( const double pitch_bend_ratio )
+wav_block_t WavWrapper::read( const long first,
+                              const size_t count,
+                              float* left_scratch,
+                              float* right_scratch ) const
 {
-  vector<float> new_samples( samples_.size() * 2 ); /* hopefully enough samples */
+  if ( first < -long( lead_frames ) or first + count > stride_ - lead_frames ) {
+    throw out_of_range( "WavWrapper::read: frames " + to_string( first ) + " + " + to_string( count )
+                        + " are outside the padded sample" );
+  }
 
-  SRC_DATA resample_info;
-  resample_info.data_in = samples_.data();
-  resample_info.data_out = new_samples.data();
-  resample_info.input_frames = samples_.size() / NUM_CHANNELS;
-  resample_info.output_frames = new_samples.size() / NUM_CHANNELS;
-  resample_info.src_ratio = pitch_bend_ratio;
+  const size_t start = first + lead_frames;
 
-  const int ret = src_simple( &resample_info, SRC_SINC_FASTEST, NUM_CHANNELS );
-  if ( ret ) {
-    throw runtime_error( "libsamplerate src_simple exception: "s + src_strerror( ret ) );
-    /* XXX should use an error category */
+  if ( format_ == SampleFormat::Float32 ) {
+    return { { reinterpret_cast<const float*>( channel( 0 ) ) + start, count },
+             { reinterpret_cast<const float*>( channel( 1 ) ) + start, count } };
   }
 
-  new_samples.resize( NUM_CHANNELS * resample_info.output_frames_gen );
-
-  samples_.swap( new_samples );
+  decode_samples( format_, channel( 0 ), scales( 0 ), start, count, left_scratch );
+  decode_samples( format_, channel( 1 ), scales( 1 ), start, count, right_scratch );
+  return { { left_scratch, count }, { right_scratch, count } };
 }
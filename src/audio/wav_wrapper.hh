@@ -1,22 +1,97 @@
 #pragma once
 
+#include <cstdlib>
+#include <memory>
+#include <optional>
 #include <sndfile.hh>
 #include <vector>
 
+#include "sample_format.hh"
+#include "spans.hh"
+
 using wav_frame_t = std::pair<float, float>;
 
+/* a run of contiguous frames, one read-only span per channel */
+struct wav_block_t
+{
+  span_view<float> left, right;
+};
+
+/* where the rest of a partly-resident sample lives in a sample bank */
+struct StreamSource
+{
+  uint64_t offset;              /* in bytes from the start of the bank, to the left channel's leading zeros */
+  size_t stride;                /* of the whole sample */
+  std::vector<float> scales {}; /* of the whole sample, left then right (PCM16 only) */
+};
+
 /* wrap WAV file with error/validity checks */
+/* samples are stored planar in a SampleFormat: each channel is 64-byte aligned, preceded by lead_frames of zeros
+   and followed by at least padding_frames of zeros, so readers (and interpolators) can run off either end without
+   a bounds check. PCM16 scales follow the two channels. */
 class WavWrapper
 {
-  std::vector<float> samples_ {};
+public:
+  static constexpr size_t lead_frames = 16;     /* zeros before frame 0 */
+  static constexpr size_t padding_frames = 256; /* a block this long can start at any in-range offset */
+
+private:
+  struct free_deleter
+  {
+    void operator()( uint8_t* x ) const { free( x ); }
+  };
+
+  std::unique_ptr<uint8_t[], free_deleter> storage_ {}; /* empty if the samples belong to someone else */
+  const uint8_t* data_ = nullptr;                       /* start of the left channel (its leading zeros) */
+  SampleFormat format_ = SampleFormat::Float32;
+  size_t length_ = 0; /* in frames */
+  size_t stride_ = 0; /* samples in each channel, including lead and padding */
+
+  size_t resident_length_ = 0;             /* frames held in memory: all of them, unless the rest is streamed */
+  std::optional<StreamSource> stream_ {}; /* where the others are */
+
+  void store_interleaved( const std::vector<float>& samples );
+
+  const uint8_t* channel( const size_t num ) const { return data_ + num * stride_ * bytes_per_sample( format_ ); }
+  const float* scales( const size_t num ) const;
 
 public:
-  WavWrapper( const std::string& filename );
+  WavWrapper( const std::string& filename, const SampleFormat format = SampleFormat::Float32 );
+
+  /* view planar samples that live elsewhere (e.g. in a memory-mapped sample bank), laid out and padded as above;
+     storage points to the start of the left channel's leading zeros */
+  WavWrapper( const uint8_t* storage, const SampleFormat format, const size_t length, const size_t stride );
+
+  /* keep only (about) the first resident_frames of whole in memory; the rest stays in the sample bank that whole
+     was mapped from, at bank_offset */
+  WavWrapper( const WavWrapper& whole, const size_t resident_frames, const uint64_t bank_offset );
+
+  /* smallest stride that leaves room for the padding, rounded up so each channel starts on a 64-byte boundary */
+  static size_t padded_length( const size_t length );
+
+  /* bytes used by both channels (and any scales) of a sample stored with this stride */
+  static size_t storage_size( const SampleFormat format, const size_t stride );
 
   wav_frame_t view( size_t offset ) const;
   bool at_end( size_t offset ) const;
 
-  void bend_pitch( const double pitch_bend_ratio );
+  size_t length() const { return length_; }
+  size_t stride() const { return stride_; }
+  SampleFormat format() const { return format_; }
+
+  size_t resident_length() const { return resident_length_; }
+  const StreamSource* stream_source() const { return stream_ ? &stream_.value() : nullptr; }
+
+  /* Frames [first, first + count), where first may reach back into the leading zeros and the block may run into
+     the padding (which, for a streamed sample, follows the resident frames). Float32 samples are returned in
+     place; other formats are converted into the scratch buffers (count floats each) and returned from there. */
+  wav_block_t read( const long first, const size_t count, float* left_scratch, float* right_scratch ) const;
+
+  /* both channels including all padding, as laid out in memory */
+  std::string_view padded_storage() const
+  {
+    return { reinterpret_cast<const char*>( data_ ), storage_size( format_, stride_ ) };
+  }
 
   /* can't copy or assign */
   WavWrapper( const WavWrapper& other ) = delete;
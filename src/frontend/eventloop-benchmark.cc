@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include "eventloop.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr unsigned int wakeups = 20000; /* per configuration */
+static constexpr unsigned int rounds = 2000;   /* of dispatch, per trial */
+static constexpr unsigned int trials = 5;      /* report the median */
+
+string_view backend_name( const EventLoop::Backend backend )
+{
+  switch ( backend ) {
+    case EventLoop::Backend::Poll:
+      return "poll";
+    case EventLoop::Backend::Epoll:
+      return "epoll";
+    case EventLoop::Backend::IoUring:
+      return "io_uring";
+  }
+  return "?";
+}
+
+void report( const EventLoop& loop, const size_t num_rules, vector<double>& latencies )
+{
+  sort( latencies.begin(), latencies.end() );
+  cout << "  " << setw( 8 ) << backend_name( loop.backend() ) << ", rules=" << setw( 3 ) << num_rules
+       << ": median " << setw( 7 ) << latencies[latencies.size() / 2] << " ns, p99 " << setw( 7 )
+       << latencies[latencies.size() * 99 / 100] << " ns\n";
+}
+
+/* From making one of num_rules fds readable to its callback running: the cost of a wait_next_event() that has
+   something to do, which is most of them in the audio and MIDI loops. Every rule is interested, as those are. */
+void measure( const EventLoop::Backend backend, const size_t num_rules )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "eventfd" );
+
+  vector<FileDescriptor> fds;
+  steady_clock::time_point served;
+  size_t served_index = -1;
+
+  for ( size_t i = 0; i < num_rules; i++ ) {
+    fds.emplace_back( CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) );
+    fds.back().set_blocking( false );
+    loop.add_rule( category, fds.back(), Direction::In, [&, i] {
+      char buffer[sizeof( eventfd_t )];
+      fds[i].read( { buffer, sizeof( buffer ) } );
+      served = steady_clock::now();
+      served_index = i;
+    } );
+  }
+
+  minstd_rand prng { 1 };
+  vector<double> latencies;
+  latencies.reserve( wakeups );
+
+  for ( unsigned int i = 0; i < wakeups; i++ ) {
+    const size_t index = prng() % num_rules;
+
+    const auto start = steady_clock::now();
+    CheckSystemCall( "eventfd_write", eventfd_write( fds[index].fd_num(), 1 ) );
+    if ( loop.wait_next_event( -1 ) != EventLoop::Result::Success or served_index != index ) {
+      throw runtime_error( "wrong rule served" );
+    }
+    latencies.push_back( duration<double, nano>( served - start ).count() );
+  }
+
+  report( loop, num_rules, latencies );
+}
+
+/* The same, for read rules on pipes (as for MIDI input): from writing a byte to the callback having it. With poll
+   and epoll, the loop reads the pipe after waiting; with io_uring, the read is already submitted. */
+void measure_reads( const EventLoop::Backend backend, const size_t num_rules )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "pipe" );
+
+  vector<FileDescriptor> readers, writers;
+  vector<RingBuffer> buffers;
+  buffers.reserve( num_rules ); /* the rules keep pointers to them */
+  steady_clock::time_point served;
+  size_t served_index = -1;
+
+  for ( size_t i = 0; i < num_rules; i++ ) {
+    int pipe_fds[2];
+    CheckSystemCall( "pipe2", pipe2( pipe_fds, O_NONBLOCK | O_CLOEXEC ) );
+    readers.emplace_back( pipe_fds[0] );
+    writers.emplace_back( pipe_fds[1] );
+    buffers.emplace_back( sysconf( _SC_PAGESIZE ) );
+    loop.add_read_rule( category, readers.back(), buffers.back(), [&, i] {
+      buffers[i].pop( buffers[i].bytes_stored() );
+      served = steady_clock::now();
+      served_index = i;
+    } );
+  }
+
+  minstd_rand prng { 1 };
+  vector<double> latencies;
+  latencies.reserve( wakeups );
+
+  for ( unsigned int i = 0; i < wakeups; i++ ) {
+    const size_t index = prng() % num_rules;
+
+    const auto start = steady_clock::now();
+    writers[index].write( "x" );
+    if ( loop.wait_next_event( -1 ) != EventLoop::Result::Success or served_index != index ) {
+      throw runtime_error( "wrong rule served" );
+    }
+    latencies.push_back( duration<double, nano>( served - start ).count() );
+  }
+
+  report( loop, num_rules, latencies );
+}
+
+/* The loop's own cost per rule served: num_rules real-time non-fd rules, each with work to do once per wakeup, so
+   each wakeup checks every rule's interest and calls every callback, and nothing waits on the kernel */
+void dispatch( const size_t num_rules )
+{
+  EventLoop loop;
+  const size_t category = loop.add_category( "counter" );
+
+  vector<unsigned int> pending( num_rules );
+  size_t checksum = 0;
+  for ( size_t i = 0; i < num_rules; i++ ) {
+    auto rule = loop.add_rule(
+      category, [&, i] { checksum += pending[i]--; }, [&, i] { return pending[i] > 0; } );
+    rule.set_priority( EventLoop::Priority::RealTime );
+  }
+
+  vector<double> results;
+  for ( unsigned int trial = 0; trial < trials; trial++ ) {
+    const auto start = steady_clock::now();
+    for ( unsigned int i = 0; i < rounds; i++ ) {
+      fill( pending.begin(), pending.end(), 1 );
+      loop.wait_next_event( 0 );
+    }
+    results.push_back( duration<double, nano>( steady_clock::now() - start ).count() / ( rounds * num_rules ) );
+  }
+
+  if ( checksum != trials * rounds * num_rules ) {
+    throw runtime_error( "not every rule was served" );
+  }
+
+  sort( results.begin(), results.end() );
+  cout << "  rules=" << setw( 3 ) << num_rules << ": " << setprecision( 1 ) << setw( 5 ) << results[trials / 2]
+       << " ns per rule served\n";
+}
+
+void program_body()
+{
+  cout << fixed << setprecision( 0 );
+  cout << "eventfd write to callback, " << wakeups << " wakeups:\n";
+
+  for ( const size_t num_rules : { 2, 16, 256 } ) {
+    for ( const auto backend : { EventLoop::Backend::Poll, EventLoop::Backend::Epoll } ) {
+      measure( backend, num_rules );
+    }
+  }
+
+  cout << "pipe write to read rule's callback, " << wakeups << " wakeups:\n";
+  for ( const size_t num_rules : { 2, 16, 256 } ) {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      measure_reads( backend, num_rules );
+    }
+  }
+
+  cout << "dispatch, median of " << trials << " trials:\n";
+  for ( const size_t num_rules : { 2, 16, 256 } ) {
+    dispatch( num_rules );
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[0] << "\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
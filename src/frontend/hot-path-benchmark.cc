@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+#include "audio_buffer.hh"
+#include "ring_buffer.hh"
+#include "synthesizer.hh"
+#include "synthetic_samples.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr unsigned int SAMPLE_RATE = 48000;
+static constexpr double frame_budget_ns = 1e9 / SAMPLE_RATE; /* time to render one frame in real time */
+
+static constexpr uint8_t KEY_DOWN = 144;
+static constexpr uint8_t KEY_OFFSET = 21;
+static constexpr uint8_t NUM_KEYS = 88;
+static constexpr uint8_t VELOCITY = 80; /* in a crossfade zone, so two layers are read per voice */
+
+static constexpr size_t block_size = 256;         /* frames per render() call, or per buffer operation */
+static constexpr size_t frames_per_trial = 12000; /* a quarter of a second of audio */
+static constexpr unsigned int trials = 5;         /* report the median */
+
+static constexpr double press_seconds = 1.5;    /* length of the synthetic velocity layers */
+static constexpr double release_seconds = 0.25; /* length of the synthetic release samples */
+
+/* median time per frame (or per element) over the trials */
+template<class Setup, class Trial>
+double median_ns( const size_t count, Setup&& setup, Trial&& trial )
+{
+  vector<double> results;
+  for ( unsigned int i = 0; i < trials; i++ ) {
+    setup();
+    const auto start = steady_clock::now();
+    trial();
+    results.push_back( duration<double, nano>( steady_clock::now() - start ).count() / count );
+  }
+
+  sort( results.begin(), results.end() );
+  return results[trials / 2];
+}
+
+/* let any sounding voices run out, then strike num_voices keys (repeating keys past 88) */
+void restart( Synthesizer& synth, const size_t num_voices )
+{
+  vector<float> left( block_size ), right( block_size );
+  while ( synth.active_voices() ) {
+    synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+  }
+
+  for ( size_t i = 0; i < num_voices; i++ ) {
+    synth.process_new_data( KEY_DOWN, KEY_OFFSET + i % NUM_KEYS, VELOCITY );
+  }
+}
+
+/* cost of the whole synthesizer per output frame, and how many voices that cost would allow in real time */
+void synthesis( const string& sample_directory, float& checksum )
+{
+  Synthesizer synth { sample_directory };
+  vector<float> left( block_size ), right( block_size );
+
+  cout << "Synthesizer (ns/frame; max polyphony = voices that fit in " << setprecision( 0 ) << frame_budget_ns
+       << " ns/frame at 48 kHz):\n";
+
+  for ( const size_t num_voices : { 1, 2, 4, 8, 16, 32, 64, 128, 256 } ) {
+    const double per_sample = median_ns(
+      frames_per_trial,
+      [&] { restart( synth, num_voices ); },
+      [&] {
+        for ( size_t i = 0; i < frames_per_trial; i++ ) {
+          checksum += synth.calculate_curr_sample().first;
+          synth.advance_sample();
+        }
+      } );
+
+    const double block = median_ns(
+      frames_per_trial,
+      [&] { restart( synth, num_voices ); },
+      [&] {
+        for ( size_t i = 0; i < frames_per_trial; i += block_size ) {
+          synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+          checksum += left[0];
+        }
+      } );
+
+    cout << "  voices=" << setw( 3 ) << num_voices << setprecision( 1 );
+    cout << "  calculate_curr_sample+advance_sample: " << setw( 8 ) << per_sample << " ns/frame (max polyphony "
+         << setw( 5 ) << setprecision( 0 ) << num_voices * frame_budget_ns / per_sample << ")";
+    cout << "  render: " << setw( 8 ) << setprecision( 1 ) << block << " ns/frame (max polyphony " << setw( 5 )
+         << setprecision( 0 ) << num_voices * frame_budget_ns / block << ")\n";
+  }
+}
+
+/* the note-on lookup: which layers, and at what gains, for a key and velocity */
+void layer_lookup( const string& sample_directory, float& checksum )
+{
+  const NoteRepository repo { sample_directory };
+  constexpr size_t lookups = 1000000;
+
+  minstd_rand prng { 1 };
+  vector<uint8_t> keys( lookups ), velocities( lookups );
+  for ( size_t i = 0; i < lookups; i++ ) {
+    keys[i] = prng() % NUM_KEYS;
+    velocities[i] = 1 + prng() % 127;
+  }
+
+  const double ns = median_ns(
+    lookups,
+    [] {},
+    [&] {
+      for ( size_t i = 0; i < lookups; i++ ) {
+        checksum += repo.layers( i % 2, keys[i], velocities[i] ).first_gain;
+      }
+    } );
+
+  cout << "NoteRepository::layers: " << setprecision( 1 ) << ns << " ns/note-on ("
+       << setprecision( 0 ) << frame_budget_ns / ns << " note-ons per frame budget)\n";
+}
+
+/* fixed per-frame costs around the synthesizer, whatever the polyphony */
+void report_fixed_cost( const string& name, const double ns, const string& unit = "frame" )
+{
+  cout << setw( 32 ) << name << ": " << setprecision( 2 ) << setw( 7 ) << ns << " ns/" << unit << " ("
+       << setprecision( 3 ) << 100 * ns / frame_budget_ns << "% of the frame budget)\n";
+}
+
+/* the stereo float -> S32 conversion and interleave that AudioInterface::play() does, a frame at a time (as it
+   used to) and in bulk */
+void conversion( float& checksum )
+{
+  ChannelPair signal { 16384 };
+  minstd_rand prng { 1 };
+  uniform_real_distribution<float> amplitude { -1.1, 1.1 }; /* including some to clip */
+  for ( size_t i = 0; i < 16384; i++ ) {
+    signal.safe_set( i, { amplitude( prng ), amplitude( prng ) } );
+  }
+
+  vector<int32_t> interleaved( 2 * frames_per_trial ), reference( 2 * frames_per_trial );
+  const double per_frame_ns = median_ns(
+    frames_per_trial,
+    [] {},
+    [&] {
+      for ( size_t i = 0; i < frames_per_trial; i++ ) {
+        const auto sample = signal.safe_get( i );
+        reference[2 * i] = float_to_sample( sample.first );
+        reference[2 * i + 1] = float_to_sample( sample.second );
+      }
+      checksum += reference[7];
+    } );
+
+  const double bulk_ns = median_ns(
+    frames_per_trial,
+    [] {},
+    [&] {
+      signal.copy_interleaved_s32( 0, frames_per_trial, interleaved.data() );
+      checksum += interleaved[7];
+    } );
+
+  if ( interleaved != reference ) {
+    throw runtime_error( "bulk float -> S32 conversion differs from float_to_sample()" );
+  }
+
+  report_fixed_cost( "float -> S32, per frame", per_frame_ns );
+  report_fixed_cost( "float -> S32, bulk (play)", bulk_ns );
+}
+
+/* writing a block to the output signal, then popping it once played, as the audio thread does */
+void endless_buffer( float& checksum )
+{
+  ChannelPair signal { 16384 };
+  size_t written = 0;
+
+  const double ns = median_ns(
+    frames_per_trial,
+    [] {},
+    [&] {
+      for ( size_t i = 0; i < frames_per_trial; i += block_size ) {
+        span<float> left = signal.ch1().region( written, block_size );
+        span<float> right = signal.ch2().region( written, block_size );
+        left[0] = right[block_size - 1] = i;
+        written += block_size;
+        checksum += signal.safe_get( written - block_size ).first;
+        signal.pop_before( written );
+      }
+    } );
+
+  report_fixed_cost( "EndlessBuffer region + pop", ns );
+}
+
+/* bytes through a RingBuffer, a block at a time (as MIDI input or a socket would use it) */
+void ring_buffer( float& checksum )
+{
+  RingBuffer buffer { size_t( sysconf( _SC_PAGESIZE ) ) };
+  const string block( block_size, 'x' );
+  constexpr size_t bytes_per_trial = 64 * 1024 * 1024;
+
+  const double ns = median_ns(
+    bytes_per_trial,
+    [] {},
+    [&] {
+      for ( size_t i = 0; i < bytes_per_trial; i += block_size ) {
+        buffer.push_from_const_str( block );
+        checksum += buffer.readable_region()[0];
+        buffer.pop( block_size );
+      }
+    } );
+
+  report_fixed_cost( "RingBuffer push + pop", ns, "byte" );
+}
+
+void program_body()
+{
+  cerr << "Generating synthetic samples... ";
+  const SyntheticSamples samples { press_seconds, release_seconds };
+  cerr << "done.\n";
+
+  float checksum = 0; /* keep the compiler from discarding the results */
+  cout << fixed;
+
+  synthesis( samples.directory(), checksum );
+  layer_lookup( samples.directory(), checksum );
+  conversion( checksum );
+  endless_buffer( checksum );
+  ring_buffer( checksum );
+
+  cerr << "checksum: " << checksum << "\n";
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[0] << "\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
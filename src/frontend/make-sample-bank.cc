@@ -0,0 +1,47 @@
+#include <chrono>
+#include <iostream>
+
+#include "note_repository.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void program_body( const string& sample_directory, const string& bank_filename, const SampleFormat format )
+{
+  /* decode every WAV file, the slow way */
+  const auto decode_start = steady_clock::now();
+  const NoteRepository decoded { sample_directory, format };
+  const auto decode_elapsed = steady_clock::now() - decode_start;
+
+  decoded.write_bank( bank_filename );
+
+  /* and map the bank back in, the way the synthesizer will */
+  const auto map_start = steady_clock::now();
+  const NoteRepository mapped { bank_filename };
+  const auto map_elapsed = steady_clock::now() - map_start;
+
+  cout << "Wrote " << bank_filename << " (" << format_name( format ) << ")\n";
+  cout << "Startup from WAV files: " << duration_cast<milliseconds>( decode_elapsed ).count() << " ms\n";
+  cout << "Startup from sample bank: " << duration_cast<microseconds>( map_elapsed ).count() << " us\n";
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 3 and argc != 4 ) {
+      cerr << "Usage: " << argv[0] << " [sample_directory] [bank_file] [float32|pcm24|pcm16|float16]\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body( argv[1], argv[2], argc == 4 ? parse_sample_format( argv[3] ) : SampleFormat::Float32 );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
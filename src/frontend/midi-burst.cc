@@ -0,0 +1,64 @@
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "exception.hh"
+#include "file_descriptor.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr uint8_t KEY_DOWN = 144;
+static constexpr uint8_t KEY_UP = 128;
+static constexpr uint8_t KEY_OFFSET = 21;
+static constexpr uint8_t NUM_KEYS = 88;
+static constexpr uint8_t VELOCITY = 100;
+
+/* stress test: write bursts of simultaneous notes to a MIDI device (or a FIFO that synthesizer-test reads) */
+void program_body( const string& midi_filename, const unsigned int notes_per_burst, const unsigned int bursts )
+{
+  FileDescriptor output { CheckSystemCall( midi_filename, open( midi_filename.c_str(), O_WRONLY ) ) };
+
+  for ( unsigned int burst = 0; burst < bursts; burst++ ) {
+    string bytes;
+    for ( uint8_t direction : { KEY_DOWN, KEY_UP } ) {
+      for ( unsigned int i = 0; i < notes_per_burst; i++ ) {
+        bytes.push_back( direction );
+        bytes.push_back( KEY_OFFSET + ( burst * 7 + i ) % NUM_KEYS );
+        bytes.push_back( VELOCITY );
+      }
+    }
+
+    string_view remaining = bytes;
+    while ( not remaining.empty() ) {
+      remaining.remove_prefix( output.write( remaining ) );
+    }
+
+    this_thread::sleep_for( milliseconds( 100 ) );
+  }
+
+  cerr << "Sent " << bursts << " bursts of " << notes_per_burst << " notes\n";
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 4 ) {
+      cerr << "Usage: " << argv[0] << " [midi_device_or_fifo] [notes_per_burst] [bursts]\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body( argv[1], stoul( argv[2] ), stoul( argv[3] ) );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "midi_processor.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t stream_size = 1024 * 1024; /* bytes of synthetic MIDI */
+static constexpr size_t read_size = 256;           /* bytes handed to the parser at once, like a device read */
+static constexpr unsigned int trials = 20;
+
+/* A stream that exercises the whole parser: running status (with note-offs as zero-velocity note-ons), explicit
+   status bytes on several channels, one-byte messages, SysEx, and clock bytes in the middle of messages */
+string synthetic_stream( size_t& expected_events )
+{
+  minstd_rand prng { 1 };
+  auto random = [&]( const unsigned int n ) { return uint8_t( prng() % n ); };
+
+  string stream;
+  expected_events = 0;
+
+  auto data_byte = [&]( const uint8_t value ) {
+    if ( random( 16 ) == 0 ) {
+      stream.push_back( char( 0xf8 ) ); /* timing clock */
+    }
+    stream.push_back( char( value ) );
+  };
+
+  while ( stream.size() < stream_size ) {
+    switch ( random( 32 ) ) {
+      case 0: /* SysEx */
+        stream.push_back( char( 0xf0 ) );
+        for ( unsigned int i = random( 64 ); i > 0; i-- ) {
+          stream.push_back( char( random( 128 ) ) );
+        }
+        stream.push_back( char( 0xf7 ) );
+        break;
+
+      case 1: /* program change, then channel pressure */
+        stream.push_back( char( 0xc0 | random( 16 ) ) );
+        data_byte( random( 128 ) );
+        stream.push_back( char( 0xd0 | random( 16 ) ) );
+        data_byte( random( 128 ) );
+        expected_events += 2;
+        break;
+
+      case 2: /* sustain pedal */
+        stream.push_back( char( 0xb0 | random( 16 ) ) );
+        data_byte( 64 );
+        data_byte( random( 2 ) * 127 );
+        expected_events++;
+        break;
+
+      default: /* a run of notes on one channel, under running status */
+        stream.push_back( char( 0x90 | random( 16 ) ) );
+        for ( unsigned int i = 1 + random( 16 ); i > 0; i-- ) {
+          data_byte( 21 + random( 88 ) );
+          data_byte( random( 128 ) );
+          expected_events++;
+        }
+        break;
+    }
+
+    if ( random( 8 ) == 0 ) {
+      stream.push_back( char( 0xfe ) ); /* active sense */
+    }
+  }
+
+  return stream;
+}
+
+void program_body()
+{
+  size_t expected_events;
+  const string stream = synthetic_stream( expected_events );
+
+  duration<double> best { numeric_limits<double>::max() };
+  size_t checksum = 0; /* keep the compiler from discarding the events */
+
+  for ( unsigned int trial = 0; trial < trials; trial++ ) {
+    MidiProcessor midi;
+    size_t events = 0;
+
+    const auto start = steady_clock::now();
+    for ( size_t pos = 0; pos < stream.size(); pos += read_size ) {
+      string_view chunk = string_view( stream ).substr( pos, read_size );
+      while ( not chunk.empty() ) {
+        midi.read_from_str( chunk );
+        while ( midi.has_event() ) {
+          checksum += midi.get_event_type() + midi.get_event_note() + midi.get_event_velocity();
+          midi.pop_event();
+          events++;
+        }
+      }
+    }
+    best = min( best, duration<double>( steady_clock::now() - start ) );
+
+    if ( events != expected_events ) {
+      throw runtime_error( "parsed " + to_string( events ) + " events, expected " + to_string( expected_events ) );
+    }
+  }
+
+  cout << fixed << setprecision( 1 );
+  cout << stream.size() / 1024 << " KiB, " << expected_events << " events: best of " << trials << " trials "
+       << best.count() * 1e3 << " ms = " << stream.size() / best.count() / 1e6 << " MB/s, "
+       << expected_events / best.count() / 1e6 << " M events/s\n";
+
+  cerr << "checksum: " << checksum << "\n";
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[0] << "\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
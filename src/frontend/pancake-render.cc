@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "midi_file.hh"
+#include "synthesizer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr unsigned int SAMPLE_RATE = 48000;
+
+static constexpr size_t block_size = 256;         /* samples per render() call */
+static constexpr double max_tail_seconds = 30.0; /* after the last event, for the notes to die away */
+
+/* render a MIDI file to a WAV file, as fast as possible */
+void program_body( const string& sample_directory, const string& midi_filename, const string& output_filename )
+{
+  const MidiFile midi { midi_filename };
+  cerr << midi_filename << ": format " << midi.format() << ", " << midi.track_count() << " tracks, "
+       << midi.events().size() << " events, " << fixed << setprecision( 1 ) << midi.duration() << " s\n";
+
+  const auto load_start = steady_clock::now();
+  Synthesizer synth { sample_directory };
+  const duration<double> load_time = steady_clock::now() - load_start;
+
+  SndfileHandle output { output_filename, SFM_WRITE, SF_FORMAT_WAV | SF_FORMAT_PCM_24, 2, SAMPLE_RATE };
+  if ( output.error() ) {
+    throw runtime_error( output_filename + ": " + output.strError() );
+  }
+  output.command( SFC_SET_CLIPPING, nullptr, SF_TRUE );
+
+  vector<float> left( block_size ), right( block_size ), interleaved( 2 * block_size );
+  const size_t end_of_events = lrint( midi.duration() * SAMPLE_RATE );
+  const size_t last_sample = end_of_events + lrint( max_tail_seconds * SAMPLE_RATE );
+  size_t next_event = 0;
+  duration<double> render_time {};
+
+  const auto start = steady_clock::now();
+  while ( synth.frames_processed_count() < last_sample
+          and ( synth.frames_processed_count() < end_of_events or synth.active_voices() ) ) {
+    const size_t first_sample = synth.frames_processed_count();
+
+    /* hand over the events in this block, to be applied on their exact samples */
+    const auto render_start = steady_clock::now();
+    for ( ; next_event < midi.events().size(); next_event++ ) {
+      const auto& [time, event] = midi.events()[next_event];
+      const size_t sample = lrint( time * SAMPLE_RATE );
+      if ( sample >= first_sample + block_size ) {
+        break;
+      }
+
+      synth.schedule( sample, event );
+    }
+
+    synth.render( first_sample, { left.data(), block_size }, { right.data(), block_size } );
+    render_time += steady_clock::now() - render_start;
+
+    for ( size_t i = 0; i < block_size; i++ ) {
+      interleaved[2 * i] = left[i];
+      interleaved[2 * i + 1] = right[i];
+    }
+
+    if ( output.writef( interleaved.data(), block_size ) != block_size ) {
+      throw runtime_error( output_filename + ": " + output.strError() );
+    }
+  }
+  const duration<double> total_time = steady_clock::now() - start;
+
+  const double audio_seconds = double( synth.frames_processed_count() ) / SAMPLE_RATE;
+  cerr << "Loaded samples in " << setprecision( 2 ) << load_time.count() << " s\n";
+  cerr << "Rendered " << audio_seconds << " s of audio in " << total_time.count() << " s: ";
+  cout << fixed << setprecision( 1 ) << audio_seconds / total_time.count() << "x real time";
+  cout << " (synthesis alone " << audio_seconds / render_time.count() << "x)\n";
+
+  /* including how many notes fell outside the piano's range */
+  synth.event_schedule()->summary( cerr );
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 4 ) {
+      cerr << "Usage: " << argv[0] << " [sample_directory] [midi_file] [output_wav]\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body( argv[1], argv[2], argv[3] );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
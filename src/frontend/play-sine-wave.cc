@@ -38,7 +38,7 @@ void program_body( const string_view device_prefix )
   size_t next_sample_to_calculate = 0; // what's the next sample # to be written to the output signal?
 
   /* rule #1: write a continuous sine wave (but no more than 1.3 ms into the future) */
-  event_loop->add_rule(
+  auto calculate_rule = event_loop->add_rule(
     "calculate sine wave",
     [&] {
       while ( next_sample_to_calculate <= playback_interface->cursor() + 64 ) {
@@ -53,7 +53,7 @@ void program_body( const string_view device_prefix )
     [&] { return next_sample_to_calculate <= playback_interface->cursor() + 64; } );
 
   /* rule #2: play the output signal whenever space available in audio output buffer */
-  event_loop->add_rule(
+  auto play_rule = event_loop->add_rule(
     "play sine wave",
     playback_interface->fd(), /* file descriptor event cares about */
     Direction::Out,           /* execute rule when file descriptor is "writeable"
@@ -72,13 +72,17 @@ void program_body( const string_view device_prefix )
           return true;
     } );
 
+  /* the audio rules are served ahead of anything else that's ready */
+  calculate_rule.set_priority( EventLoop::Priority::RealTime );
+  play_rule.set_priority( EventLoop::Priority::RealTime );
+
   /* add a task that prints statistics occasionally */
   StatsPrinterTask stats_printer { event_loop };
 
   stats_printer.add( playback_interface );
 
   /* run the event loop forever */
-  while ( event_loop->wait_next_event( stats_printer.wait_time_ms() ) != EventLoop::Result::Exit ) {
+  while ( event_loop->wait_next_event( -1 ) != EventLoop::Result::Exit ) {
   }
 }
 
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+#include "exception.hh"
+#include "typed_ring_buffer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t capacity = 4096;             /* elements: 64 KiB of Messages */
+static constexpr size_t throughput_count = 50000000; /* elements per throughput trial */
+static constexpr size_t latency_count = 1000000;     /* elements per latency trial */
+static constexpr size_t max_batch = 64;              /* most elements pushed or popped at once */
+
+struct Message
+{
+  uint64_t sequence;
+  uint64_t sent_ns;
+};
+
+uint64_t now_ns()
+{
+  return duration_cast<nanoseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+void pin_to_cpu( const unsigned int cpu )
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( cpu, &cpus );
+  if ( const int err = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) ) {
+    throw unix_error( "pthread_setaffinity_np( CPU " + to_string( cpu ) + " )", err );
+  }
+}
+
+/* run the consumer on one CPU while this thread produces on another */
+template<class Producer, class Consumer>
+steady_clock::duration run_pair( const unsigned int producer_cpu,
+                                 const unsigned int consumer_cpu,
+                                 Producer&& producer,
+                                 Consumer&& consumer )
+{
+  pin_to_cpu( producer_cpu );
+  const auto start = steady_clock::now();
+  exception_ptr consumer_error {};
+  thread consumer_thread { [&] {
+    try {
+      pin_to_cpu( consumer_cpu );
+      consumer();
+    } catch ( ... ) {
+      consumer_error = current_exception();
+    }
+  } };
+  producer();
+  consumer_thread.join();
+
+  if ( consumer_error ) {
+    rethrow_exception( consumer_error );
+  }
+  return steady_clock::now() - start;
+}
+
+/* every element must arrive, in order */
+void check_sequence( const uint64_t expected, const uint64_t received )
+{
+  if ( expected != received ) {
+    throw runtime_error( "element " + to_string( expected ) + " arrived as " + to_string( received ) );
+  }
+}
+
+void report_throughput( const string& name, const steady_clock::duration elapsed )
+{
+  cout << setw( 28 ) << name << ": " << setw( 8 ) << throughput_count / duration<double>( elapsed ).count() / 1e6
+       << " M elements/s\n";
+}
+
+/* lock-free: whole regions at a time */
+void spsc_throughput( const unsigned int producer_cpu, const unsigned int consumer_cpu )
+{
+  SPSCRingBuffer<Message> buffer { capacity };
+
+  const auto elapsed = run_pair(
+    producer_cpu,
+    consumer_cpu,
+    [&] {
+      for ( uint64_t sequence = 0; sequence < throughput_count; ) {
+        span<Message> region = buffer.writable_region();
+        const size_t count = min( { region.size(), max_batch, size_t( throughput_count - sequence ) } );
+        for ( size_t i = 0; i < count; i++ ) {
+          region[i] = { sequence++, 0 };
+        }
+        buffer.push( count );
+      }
+    },
+    [&] {
+      for ( uint64_t expected = 0; expected < throughput_count; ) {
+        const span_view<Message> region = buffer.readable_region();
+        const size_t count = min( region.size(), max_batch );
+        for ( size_t i = 0; i < count; i++ ) {
+          check_sequence( expected++, region[i].sequence );
+        }
+        buffer.pop( count );
+      }
+    } );
+
+  report_throughput( "SPSCRingBuffer", elapsed );
+}
+
+/* for comparison: the single-threaded TypedRingBuffer behind a mutex */
+void locked_throughput( const unsigned int producer_cpu, const unsigned int consumer_cpu )
+{
+  TypedRingBuffer<Message> buffer { capacity };
+  mutex buffer_mutex;
+
+  const auto elapsed = run_pair(
+    producer_cpu,
+    consumer_cpu,
+    [&] {
+      for ( uint64_t sequence = 0; sequence < throughput_count; ) {
+        unique_lock lock { buffer_mutex };
+        span<Message> region = buffer.writable_region();
+        const size_t count = min( { region.size(), max_batch, size_t( throughput_count - sequence ) } );
+        for ( size_t i = 0; i < count; i++ ) {
+          region[i] = { sequence++, 0 };
+        }
+        buffer.push( count );
+      }
+    },
+    [&] {
+      for ( uint64_t expected = 0; expected < throughput_count; ) {
+        unique_lock lock { buffer_mutex };
+        const span_view<Message> region = buffer.readable_region();
+        const size_t count = min( region.size(), max_batch );
+        for ( size_t i = 0; i < count; i++ ) {
+          check_sequence( expected++, region[i].sequence );
+        }
+        buffer.pop( count );
+      }
+    } );
+
+  report_throughput( "TypedRingBuffer + mutex", elapsed );
+}
+
+/* one element at a time, spaced out so the buffer is usually empty: how long until the consumer sees each one */
+void spsc_latency( const unsigned int producer_cpu, const unsigned int consumer_cpu )
+{
+  SPSCRingBuffer<Message> buffer { capacity };
+  vector<uint64_t> latencies;
+  latencies.reserve( latency_count );
+
+  run_pair(
+    producer_cpu,
+    consumer_cpu,
+    [&] {
+      for ( uint64_t sequence = 0; sequence < latency_count; sequence++ ) {
+        const uint64_t sent = now_ns();
+        while ( not buffer.try_push( { sequence, sent } ) ) {
+        }
+        while ( now_ns() < sent + 1000 ) {
+        }
+      }
+    },
+    [&] {
+      for ( uint64_t expected = 0; expected < latency_count; ) {
+        const span_view<Message> region = buffer.readable_region();
+        if ( region.size() == 0 ) {
+          continue;
+        }
+        const uint64_t received = now_ns();
+        for ( const Message& message : region ) {
+          check_sequence( expected++, message.sequence );
+          latencies.push_back( received - message.sent_ns );
+        }
+        buffer.pop( region.size() );
+      }
+    } );
+
+  sort( latencies.begin(), latencies.end() );
+  auto percentile = [&]( const double p ) { return latencies.at( size_t( p * ( latencies.size() - 1 ) ) ); };
+
+  cout << setw( 28 ) << "SPSCRingBuffer latency" << ": min " << latencies.front() << " ns, median "
+       << percentile( 0.5 ) << " ns, 99% " << percentile( 0.99 ) << " ns, 99.9% " << percentile( 0.999 )
+       << " ns, max " << latencies.back() << " ns\n";
+}
+
+void program_body( const unsigned int producer_cpu, const unsigned int consumer_cpu )
+{
+  /* check both CPUs up front: a consumer that can't start would leave the producer waiting forever */
+  cpu_set_t allowed;
+  CheckSystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+  for ( const unsigned int cpu : { producer_cpu, consumer_cpu } ) {
+    if ( cpu >= CPU_SETSIZE or not CPU_ISSET( cpu, &allowed ) ) {
+      throw runtime_error( "CPU " + to_string( cpu ) + " is not available" );
+    }
+  }
+
+  cout << fixed << setprecision( 1 );
+  cout << "producer on CPU " << producer_cpu << ", consumer on CPU " << consumer_cpu << "\n";
+
+  spsc_throughput( producer_cpu, consumer_cpu );
+  locked_throughput( producer_cpu, consumer_cpu );
+  spsc_latency( producer_cpu, consumer_cpu );
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 and argc != 3 ) {
+      cerr << "Usage: " << argv[0] << " [producer_cpu consumer_cpu]\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body( argc == 3 ? stoul( argv[1] ) : 0, argc == 3 ? stoul( argv[2] ) : 1 );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
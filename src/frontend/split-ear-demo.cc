@@ -80,7 +80,7 @@ void program_body( const string_view audio_device, const string& midi_device )
   array<float, 16> past_timestamps {};
 
   /* rule #1: write a continuous sine wave (but no more than 1.3 ms into the future) */
-  event_loop->add_rule(
+  auto calculate_rule = event_loop->add_rule(
     "calculate sine wave",
     [&] {
       while ( next_sample_to_calculate <= playback_interface->cursor() + audio_horizon ) {
@@ -103,7 +103,7 @@ void program_body( const string_view audio_device, const string& midi_device )
     [&] { return next_sample_to_calculate <= playback_interface->cursor() + audio_horizon; } );
 
   /* rule #2: play the output signal whenever space available in audio output buffer */
-  event_loop->add_rule(
+  auto play_rule = event_loop->add_rule(
     "play sine wave",
     playback_interface->fd(), /* file descriptor event cares about */
     Direction::Out,           /* execute rule when file descriptor is "writeable"
@@ -135,8 +135,10 @@ void program_body( const string_view audio_device, const string& midi_device )
     "process MIDI event",
     [&] {
       while ( midi.has_event() ) {
-        float time_val = midi.pop_event() / 1.0;
-        if ( midi.get_event_type() == 144 ) { /* key down */
+        const uint8_t event_type = midi.get_event_type();
+        float time_val = midi.time_since_reset() / 1.0;
+        midi.pop_event();
+        if ( event_type == 144 ) { /* key down */
           amp_left = max_amplitude;
           if ( num_notes < 16 ) {
             press_queue.push_back( time_val );
@@ -147,21 +149,24 @@ void program_body( const string_view audio_device, const string& midi_device )
             press_queue.pop_front();
           }
         }
-        midi.pop_event();
       }
     },
     [&] { return midi.has_event(); } );
 
   /* rule #5: get DNN prediction */
-  event_loop->add_rule(
+  event_loop->add_timer_rule(
     "get DNN prediction",
+    milliseconds( 50 ),
     [&] {
       last_pred_time = steady_clock::now();
       past_timestamps = calculate_input( press_queue, num_notes, last_pred_time );
       float time_to_next = nn.predict_next_timestamp( past_timestamps );
       next_note_pred = last_pred_time + round<milliseconds>(duration<float>{time_to_next});
-    },
-    [&] { return duration_cast<milliseconds>(steady_clock::now() - last_pred_time).count() >= 50; } );
+    } );
+
+  /* the audio rules are served ahead of anything else that's ready */
+  calculate_rule.set_priority( EventLoop::Priority::RealTime );
+  play_rule.set_priority( EventLoop::Priority::RealTime );
 
   /* add a task that prints statistics occasionally */
   StatsPrinterTask stats_printer { event_loop };
@@ -169,7 +174,7 @@ void program_body( const string_view audio_device, const string& midi_device )
   stats_printer.add( playback_interface );
 
   /* run the event loop forever */
-  while ( event_loop->wait_next_event( stats_printer.wait_time_ms() ) != EventLoop::Result::Exit ) {
+  while ( event_loop->wait_next_event( -1 ) != EventLoop::Result::Exit ) {
   }
 }
 
@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+#include "synthesizer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr uint8_t KEY_DOWN = 144;
+static constexpr uint8_t KEY_OFFSET = 21;
+static constexpr uint8_t VELOCITY = 80; /* in a crossfade zone, so two layers are read per voice */
+
+static constexpr size_t block_size = 64;         /* samples per render() call */
+static constexpr size_t frames_per_trial = 48000; /* one second of audio */
+
+/* let any sounding voices run out, so each trial starts from silence */
+void drain( Synthesizer& synth )
+{
+  vector<float> left( block_size ), right( block_size );
+  while ( synth.active_voices() ) {
+    synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+  }
+}
+
+void press_keys( Synthesizer& synth, const size_t num_voices )
+{
+  for ( size_t i = 0; i < num_voices; i++ ) {
+    synth.process_new_data( KEY_DOWN, KEY_OFFSET + i, VELOCITY );
+  }
+}
+
+double frames_per_second( const steady_clock::duration elapsed )
+{
+  return frames_per_trial / duration<double>( elapsed ).count();
+}
+
+/* resident set size of this process, in bytes */
+size_t resident_bytes()
+{
+  ifstream statm { "/proc/self/statm" };
+  size_t total_pages = 0, resident_pages = 0;
+  if ( not( statm >> total_pages >> resident_pages ) ) {
+    throw runtime_error( "could not read /proc/self/statm" );
+  }
+  return resident_pages * sysconf( _SC_PAGESIZE );
+}
+
+/* memory and mix throughput for each way of storing the samples */
+void compare_formats( const string& sample_directory )
+{
+  constexpr size_t num_voices = 64;
+  vector<float> left( block_size ), right( block_size );
+  float checksum = 0;
+
+  for ( const auto format :
+        { SampleFormat::Float32, SampleFormat::PCM24, SampleFormat::PCM16, SampleFormat::Float16 } ) {
+    const size_t resident_before = resident_bytes();
+    Synthesizer synth { sample_directory, 256, Synthesizer::StealPolicy::Oldest, format };
+    const size_t resident_after = resident_bytes();
+
+    press_keys( synth, num_voices );
+    const auto start = steady_clock::now();
+    for ( size_t i = 0; i < frames_per_trial; i += block_size ) {
+      synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+      checksum += left[0];
+    }
+    const auto elapsed = steady_clock::now() - start;
+
+    cout << "format=" << setw( 7 ) << format_name( format );
+    cout << "  samples resident: " << setw( 5 ) << ( resident_after - resident_before ) / ( 1024 * 1024 ) << " MiB";
+    cout << "  block, " << num_voices << " voices: " << setw( 10 ) << frames_per_second( elapsed ) << " frames/s\n";
+  }
+
+  cerr << "checksum: " << checksum << "\n";
+}
+
+void program_body( const string& sample_directory )
+{
+  Synthesizer synth { sample_directory };
+
+  vector<float> left( block_size ), right( block_size );
+  float checksum = 0; /* keep the compiler from discarding the output */
+
+  cout << fixed << setprecision( 0 );
+
+  /* Both paths below read the same voice list, so this compares the per-sample API with render(), not the
+     Synthesizer from before render() existed (whose per-voice state was laid out differently). */
+  for ( const size_t num_voices : { 1, 16, 64 } ) {
+    /* calculate_curr_sample()/advance_sample(), one sample at a time */
+    drain( synth );
+    press_keys( synth, num_voices );
+    const auto per_sample_start = steady_clock::now();
+    for ( size_t i = 0; i < frames_per_trial; i++ ) {
+      checksum += synth.calculate_curr_sample().first;
+      synth.advance_sample();
+    }
+    const auto per_sample_elapsed = steady_clock::now() - per_sample_start;
+
+    /* render(), one block at a time */
+    drain( synth );
+    press_keys( synth, num_voices );
+    const auto block_start = steady_clock::now();
+    for ( size_t i = 0; i < frames_per_trial; i += block_size ) {
+      synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+      checksum += left[0];
+    }
+    const auto block_elapsed = steady_clock::now() - block_start;
+
+    cout << "voices=" << setw( 3 ) << num_voices;
+    cout << "  per-sample API: " << setw( 10 ) << frames_per_second( per_sample_elapsed ) << " frames/s";
+    cout << "  render(): " << setw( 10 ) << frames_per_second( block_elapsed ) << " frames/s";
+    const double ratio = frames_per_second( block_elapsed ) / frames_per_second( per_sample_elapsed );
+    cout << "  (" << setprecision( 2 ) << ratio << "x)" << setprecision( 0 ) << "\n";
+  }
+
+  cerr << "checksum: " << checksum << "\n";
+
+  compare_formats( sample_directory );
+}
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 2 ) {
+      cerr << "Usage: " << argv[0] << " [sample_directory]\n";
+      return EXIT_FAILURE;
+    }
+
+    program_body( argv[1] );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
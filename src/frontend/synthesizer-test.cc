@@ -1,8 +1,11 @@
+#include <cmath>
 #include <iostream>
+#include <optional>
 #include <set>
 
 #include "alsa_devices.hh"
 #include "audio_device_claim.hh"
+#include "audio_thread.hh"
 #include "eventloop.hh"
 #include "midi_processor.hh"
 #include "stats_printer.hh"
@@ -12,24 +15,48 @@
 
 using namespace std;
 
-void program_body( const string_view device_prefix, const string& midi_filename, const string& sample_directory )
+/* optional settings after the three required arguments */
+struct Options
+{
+  unsigned int resident_ms = 0; /* nonzero: stream samples from a sample bank, keeping this much resident */
+  bool audio_thread = false;    /* render and play on a real-time thread instead of in the event loop */
+  optional<unsigned int> audio_cpu {};
+  double latency_ms = 4; /* from a MIDI event's arrival to its sound leaving the audio device */
+  EventLoop::Backend event_loop = EventLoop::Backend::Epoll;
+};
+
+void program_body( const string_view device_prefix,
+                   const string& midi_filename,
+                   const string& sample_directory,
+                   const Options& options )
 {
   /* speed up C++ I/O by decoupling from C standard I/O */
   ios::sync_with_stdio( false );
 
+  /* (before the event loop, which may have a read into its buffer until it's destroyed) */
+  MidiProcessor midi_processor {};
+
   /* create event loop */
-  auto event_loop = make_shared<EventLoop>();
+  auto event_loop = make_shared<EventLoop>( options.event_loop );
+  if ( event_loop->backend() != options.event_loop ) {
+    cerr << "io_uring is not available; using poll\n";
+  }
+
+  /* a stand-in for the sound card ("null", "file:out.wav", ...), or else find the audio device */
+  shared_ptr<AudioOutput> playback_interface = AudioOutput::open_without_hardware( device_prefix );
+  optional<AudioDeviceClaim> device_claim;
+  if ( not playback_interface ) {
+    auto [name, interface_name] = ALSADevices::find_device( { device_prefix } );
 
-  /* find the audio device */
-  auto [name, interface_name] = ALSADevices::find_device( { device_prefix } );
+    /* claim exclusive access to the audio device */
+    device_claim = AudioDeviceClaim::try_claim( name );
 
-  /* claim exclusive access to the audio device */
-  const auto device_claim = AudioDeviceClaim::try_claim( name );
+    /* use ALSA to initialize and configure audio device */
+    const auto short_name = device_prefix.substr( 0, 16 );
+    playback_interface = make_shared<AudioInterface>( interface_name, short_name, SND_PCM_STREAM_PLAYBACK );
+  }
 
-  /* use ALSA to initialize and configure audio device */
-  const auto short_name = device_prefix.substr( 0, 16 );
-  auto playback_interface = make_shared<AudioInterface>( interface_name, short_name, SND_PCM_STREAM_PLAYBACK );
-  AudioInterface::Configuration config;
+  AudioOutput::Configuration config;
   config.sample_rate = 48000; /* samples per second */
   config.buffer_size = 96;    /* maximum samples of queued audio = 2 milliseconds */
   config.period_size = 16;    /* chunk size for kernel's management of audio buffer */
@@ -41,74 +68,144 @@ void program_body( const string_view device_prefix, const string& midi_filename,
   ChannelPair audio_signal { 16384 }; // the output signal
   size_t samples_written = 0;
 
-  FileDescriptor piano { CheckSystemCall( midi_filename, open( midi_filename.c_str(), O_RDONLY ) ) };
-  Synthesizer synth { sample_directory };
-  MidiProcessor midi_processor {};
-
-  /* rule #1: read events from MIDI piano */
-  event_loop->add_rule( "read MIDI data", piano, Direction::In, [&] { midi_processor.read_from_fd( piano ); } );
-
-  /* rule #2: let synthesizer read in new MIDI processor data */
-  event_loop->add_rule(
-    "synthesizer processes data",
-    [&] {
-      while ( midi_processor.has_event() ) {
-        synth.process_new_data(
-          midi_processor.get_event_type(), midi_processor.get_event_note(), midi_processor.get_event_velocity() );
-        midi_processor.pop_event();
-      }
-    },
-    /* when should this rule run? */
-    [&] { return midi_processor.has_event(); } );
-
-  /* rule #3: write synthesizer output to speaker (but no more than 1.3 ms into the future) */
-  event_loop->add_rule(
-    "synthesize piano",
-    [&] {
-      while ( samples_written <= playback_interface->cursor() + 64 ) {
-        pair<float, float> samp = synth.calculate_curr_sample();
-        // cout << "total samp: " << samp.first << "\n";
-        audio_signal.safe_set( samples_written, samp );
-        samples_written++;
-        synth.advance_sample();
-      }
-    },
-    /* when should this rule run? commit to an output signal until 1.3 ms in the future */
-    [&] { return samples_written <= playback_interface->cursor() + 64; } );
-
-  /* rule #4: play the output signal whenever space available in audio output buffer */
-  event_loop->add_rule(
-    "sound output",
-    playback_interface->fd(), /* file descriptor event cares about */
-    Direction::Out,           /* execute rule when file descriptor is "writeable"
-                                 -> there's room in the output buffer (config.buffer_size) */
-    [&] {
-      playback_interface->play( samples_written, audio_signal );
-      /* now that we've played these samples, pop them from the outgoing audio signal */
-      audio_signal.pop_before( playback_interface->cursor() );
-    },
-    [&] {
-      return samples_written > playback_interface->cursor();
-    },     /* rule should run as long as any new samples available to play */
-    [] {}, /* no callback if EOF or closed */
-    [&] {  /* on error such as buffer overrun/underrun, recover the ALSA interface */
-          playback_interface->recover();
-          return true;
-    } );
+  Synthesizer synth {
+    sample_directory, 256, Synthesizer::StealPolicy::Oldest, SampleFormat::Float32, options.resident_ms };
 
   /* add a task that prints statistics occasionally */
   StatsPrinterTask stats_printer { event_loop };
+  stats_printer.add( synth.streamer() );
+  stats_printer.add( synth.event_schedule() );
 
-  stats_printer.add( playback_interface );
+  /* each MIDI event plays a fixed time after it arrived, on the sample that falls due then */
+  const unsigned int latency = lrint( options.latency_ms * config.sample_rate / 1000 );
+
+  /* rule #1: read events from MIDI piano */
+  optional<FileDescriptor> piano;
+  optional<RawMidiInput> rawmidi;
+  if ( midi_filename.substr( 0, 3 ) == "hw:" ) {
+    /* an ALSA rawmidi device: the kernel timestamps the bytes as they arrive */
+    rawmidi.emplace( midi_filename );
+    event_loop
+      ->add_rule( "read MIDI data",
+                  rawmidi->fd(),
+                  Direction::In,
+                  [&] { midi_processor.read_from_rawmidi( rawmidi.value() ); } )
+      .set_priority( EventLoop::Priority::RealTime );
+  } else {
+    piano.emplace( CheckSystemCall( midi_filename, open( midi_filename.c_str(), O_RDONLY ) ) );
+    event_loop
+      ->add_read_rule(
+        "read MIDI data", piano.value(), midi_processor.input_buffer(), [&] { midi_processor.input_arrived(); } )
+      .set_priority( EventLoop::Priority::RealTime );
+  }
+
+  shared_ptr<AudioThread> audio_thread;
+
+  if ( options.audio_thread ) {
+    /* the audio thread renders and plays from here on; the event loop only passes it MIDI */
+    AudioThread::Configuration thread_config;
+    thread_config.cpu = options.audio_cpu;
+    thread_config.latency = latency;
+    audio_thread = make_shared<AudioThread>( playback_interface, synth, thread_config );
+    stats_printer.add( audio_thread );
+
+    /* rule #2: hand new MIDI events to the audio thread */
+    auto queue_rule = event_loop->add_rule(
+      "queue MIDI for audio thread",
+      [&] {
+        while ( midi_processor.has_event() ) {
+          audio_thread->push( midi_processor.get_event() );
+          midi_processor.pop_event();
+        }
+      },
+      [&] { return midi_processor.has_event(); } );
+    queue_rule.set_priority( EventLoop::Priority::RealTime );
+  } else {
+    stats_printer.add( playback_interface );
+
+    /* rule #2: let synthesizer read in new MIDI processor data */
+    auto schedule_rule = event_loop->add_rule(
+      "synthesizer processes data",
+      [&] {
+        while ( midi_processor.has_event() ) {
+          const MidiEvent event = midi_processor.get_event();
+          synth.schedule( playback_interface->sample_at( event.arrival ) + latency, event );
+          midi_processor.pop_event();
+        }
+      },
+      /* when should this rule run? */
+      [&] { return midi_processor.has_event(); } );
+
+    /* rule #3: write synthesizer output to speaker (but no more than 1.3 ms into the future) */
+    auto synthesize_rule = event_loop->add_rule(
+      "synthesize piano",
+      [&] {
+        const size_t horizon = playback_interface->cursor() + 64;
+        if ( samples_written <= horizon ) {
+          const size_t count = horizon + 1 - samples_written;
+          synth.render( samples_written,
+                        audio_signal.ch1().region( samples_written, count ),
+                        audio_signal.ch2().region( samples_written, count ) );
+          samples_written += count;
+        }
+      },
+      /* when should this rule run? commit to an output signal until 1.3 ms in the future */
+      [&] { return samples_written <= playback_interface->cursor() + 64; } );
+
+    /* rule #4: play the output signal whenever space available in audio output buffer */
+    auto output_rule = event_loop->add_rule(
+      "sound output",
+      playback_interface->fd(), /* file descriptor event cares about */
+      Direction::Out,           /* execute rule when file descriptor is "writeable"
+                                   -> there's room in the output buffer (config.buffer_size) */
+      [&] {
+        playback_interface->play( samples_written, audio_signal );
+        /* now that we've played these samples, pop them from the outgoing audio signal */
+        audio_signal.pop_before( playback_interface->cursor() );
+      },
+      [&] {
+        return samples_written > playback_interface->cursor();
+      },     /* rule should run as long as any new samples available to play */
+      [] {}, /* no callback if EOF or closed */
+      [&] {  /* on error such as buffer overrun/underrun, recover the ALSA interface */
+            playback_interface->recover();
+            return true;
+      } );
+
+    /* the audio path goes ahead of the statistics, and is late if what was queued when the output became
+       writable could have run out */
+    const unsigned int queued_when_writable = config.buffer_size - config.avail_minimum;
+    const chrono::nanoseconds output_deadline { uint64_t( queued_when_writable ) * 1000000000
+                                                / config.sample_rate };
+    schedule_rule.set_priority( EventLoop::Priority::RealTime );
+    synthesize_rule.set_priority( EventLoop::Priority::RealTime ).set_deadline( output_deadline );
+    output_rule.set_priority( EventLoop::Priority::RealTime ).set_deadline( output_deadline );
+  }
 
   /* run the event loop forever */
-  while ( event_loop->wait_next_event( stats_printer.wait_time_ms() ) != EventLoop::Result::Exit ) {
+  while ( event_loop->wait_next_event( -1 ) != EventLoop::Result::Exit ) {
+    if ( audio_thread ) {
+      audio_thread->check();
+    }
   }
 }
 
 void usage_message( const string_view argv0 )
 {
-  cerr << "Usage: " << argv0 << " [device_prefix] [midi_device] [sample_directory]\n";
+  cerr << "Usage: " << argv0 << " [device_prefix] [midi_device] [sample_directory] [options]\n";
+  cerr << "  (midi_device is a file such as /dev/snd/midiC1D0, or an ALSA rawmidi device such as hw:1,0,0\n"
+          "   for kernel-timestamped input; `amidi -l` lists them)\n";
+  cerr << "Options:\n";
+  cerr << "  --resident-ms=N   keep only the first N ms of each sample in memory and stream the rest from disk\n"
+          "                    (sample_directory must be a sample bank)\n";
+  cerr << "  --audio-thread    render and play on a real-time (SCHED_FIFO, mlockall) thread\n";
+  cerr << "  --audio-cpu=N     ... pinned to CPU N (implies --audio-thread)\n";
+  cerr << "  --latency-ms=X    play each MIDI event X ms after it arrives (default 4; below about 3.5, events\n"
+          "                    are applied late, whenever the synthesizer next renders)\n";
+  cerr << "  --event-loop=B    wait with poll, epoll (the default) or io_uring (which reads MIDI input without a\n"
+          "                    system call of its own, and falls back to poll where the kernel lacks it)\n";
+  cerr << "In place of device_prefix, \"null\" plays to nowhere in real time, \"null-free\" as fast as possible,\n"
+          "  and \"file:out.wav\" (or \"file-rt:out.wav\", in real time) records to a WAV file.\n";
 
   cerr << "Available devices:";
 
@@ -133,12 +230,39 @@ int main( int argc, char* argv[] )
       abort();
     }
 
-    if ( argc != 4 ) {
+    if ( argc < 4 ) {
       usage_message( argv[0] );
       return EXIT_FAILURE;
     }
 
-    program_body( argv[1], argv[2], argv[3] );
+    Options options;
+    for ( int i = 4; i < argc; i++ ) {
+      const string_view arg = argv[i];
+      if ( arg.substr( 0, 14 ) == "--resident-ms=" ) {
+        options.resident_ms = stoul( string( arg.substr( 14 ) ) );
+      } else if ( arg == "--audio-thread" ) {
+        options.audio_thread = true;
+      } else if ( arg.substr( 0, 13 ) == "--latency-ms=" ) {
+        options.latency_ms = stod( string( arg.substr( 13 ) ) );
+        if ( options.latency_ms < 0 ) {
+          throw runtime_error( "latency can't be negative" );
+        }
+      } else if ( arg == "--event-loop=poll" ) {
+        options.event_loop = EventLoop::Backend::Poll;
+      } else if ( arg == "--event-loop=epoll" ) {
+        options.event_loop = EventLoop::Backend::Epoll;
+      } else if ( arg == "--event-loop=io_uring" ) {
+        options.event_loop = EventLoop::Backend::IoUring;
+      } else if ( arg.substr( 0, 12 ) == "--audio-cpu=" ) {
+        options.audio_thread = true;
+        options.audio_cpu = stoul( string( arg.substr( 12 ) ) );
+      } else {
+        usage_message( argv[0] );
+        return EXIT_FAILURE;
+      }
+    }
+
+    program_body( argv[1], argv[2], argv[3], options );
   } catch ( const exception& e ) {
     cerr << e.what() << "\n";
     return EXIT_FAILURE;
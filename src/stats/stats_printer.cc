@@ -8,10 +8,10 @@ StatsPrinterTask::StatsPrinterTask( std::shared_ptr<EventLoop> loop )
   : loop_( loop )
   , standard_output_( CheckSystemCall( "dup STDERR_FILENO", dup( STDERR_FILENO ) ) )
   , bootup_time( steady_clock::now() )
-  , next_stats_print( bootup_time + stats_print_interval )
 {
-  loop_->add_rule(
+  loop_->add_timer_rule(
     "generate+print statistics",
+    stats_print_interval,
     [&] {
       ss_.str( {} );
       ss_.clear();
@@ -35,9 +35,6 @@ StatsPrinterTask::StatsPrinterTask( std::shared_ptr<EventLoop> loop )
       global_timer().summary( ss_ );
       ss_ << "\n";
 
-      /* calculate new time */
-      next_stats_print = now + stats_print_interval;
-
       /* reset for next time */
       loop_->reset_summary();
 
@@ -47,8 +44,7 @@ StatsPrinterTask::StatsPrinterTask( std::shared_ptr<EventLoop> loop )
         output_rb_.push_from_const_str( str );
       }
       output_rb_.pop_to_fd( standard_output_ );
-    },
-    [&] { return steady_clock::now() > next_stats_print; } );
+    } );
 
   loop_->add_rule(
     "print statistics",
@@ -57,13 +53,3 @@ StatsPrinterTask::StatsPrinterTask( std::shared_ptr<EventLoop> loop )
     [&] { output_rb_.pop_to_fd( standard_output_ ); },
     [&] { return output_rb_.bytes_stored() > 0; } );
 }
-
-unsigned int StatsPrinterTask::wait_time_ms() const
-{
-  const auto now = steady_clock::now();
-  if ( now > next_stats_print ) {
-    return 0;
-  } else {
-    return duration_cast<milliseconds>( next_stats_print - now ).count();
-  }
-}
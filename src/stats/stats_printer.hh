@@ -21,7 +21,6 @@ class StatsPrinterTask
   using time_point = decltype( std::chrono::steady_clock::now() );
 
   time_point bootup_time;
-  time_point next_stats_print;
 
   static constexpr auto stats_print_interval = std::chrono::milliseconds( 2000 );
 
@@ -30,8 +29,6 @@ class StatsPrinterTask
 public:
   StatsPrinterTask( std::shared_ptr<EventLoop> loop );
 
-  unsigned int wait_time_ms() const;
-
   template<class T>
   void add( std::shared_ptr<T> obj )
   {
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "event_schedule.hh"
+#include "synthesizer.hh"
+#include "synthetic_samples.hh"
+#include "test_util.hh"
+
+using namespace std;
+
+static constexpr uint8_t KEY_DOWN = 0x90;
+static constexpr uint8_t KEY_UP = 0x80;
+
+MidiEvent note( const uint8_t type, const uint8_t key, const uint8_t velocity )
+{
+  return { type, key, velocity };
+}
+
+string summary( const EventSchedule& schedule )
+{
+  ostringstream out;
+  schedule.summary( out );
+  return out.str();
+}
+
+/* events come out in sample order, with equal samples in the order they went in */
+void test_ordering()
+{
+  EventSchedule schedule { 4 };
+  expect( not schedule.next_sample().has_value(), "a new schedule is empty" );
+
+  expect( schedule.add( 100, note( KEY_DOWN, 60, 1 ) ), "add" );
+  expect( schedule.add( 50, note( KEY_DOWN, 60, 2 ) ), "add" );
+  expect( schedule.add( 100, note( KEY_DOWN, 60, 3 ) ), "add" );
+  expect( schedule.add( 75, note( KEY_DOWN, 60, 4 ) ), "add" );
+  expect( not schedule.add( 10, note( KEY_DOWN, 60, 5 ) ), "add to a full schedule fails" );
+
+  vector<uint8_t> order;
+  for ( const size_t sample : { 50, 75, 100, 100 } ) {
+    expect( schedule.next_sample() == sample, "next sample is " + to_string( sample ) );
+    order.push_back( schedule.pop( sample ).velocity );
+  }
+  expect( order == vector<uint8_t> { 2, 4, 1, 3 }, "events in sample order, ties in arrival order" );
+  expect( not schedule.next_sample().has_value(), "all popped" );
+
+  bool threw = false;
+  try {
+    schedule.pop( 0 );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "pop from an empty schedule throws" );
+
+  /* popped events make room again, without reallocating */
+  expect( schedule.add( 200, note( KEY_DOWN, 60, 6 ) ) and schedule.add( 300, note( KEY_DOWN, 60, 7 ) ), "add" );
+  expect( schedule.pop( 200 ).velocity == 6, "pop on time" );
+  for ( unsigned int i = 0; i < 3; i++ ) {
+    expect( schedule.add( 400 + i, note( KEY_DOWN, 60, 8 + i ) ), "add after popping" );
+  }
+  expect( not schedule.add( 500, note( KEY_DOWN, 60, 11 ) ), "full again" );
+
+  /* lateness */
+  schedule.reset_summary();
+  expect( schedule.pop( 325 ).velocity == 7, "pop late" );
+  const string report = summary( schedule );
+  expect( report.find( "events=1 late=1 (by up to 25 samples)" ) != string::npos, "summary: " + report );
+}
+
+/* render blocks of block_size, with the events scheduled ahead of time */
+vector<float> render_scheduled( const string& sample_directory,
+                                const vector<pair<size_t, MidiEvent>>& events,
+                                const size_t block_size,
+                                const size_t total )
+{
+  Synthesizer synth { sample_directory };
+  for ( const auto& [sample, event] : events ) {
+    synth.schedule( sample, event );
+  }
+
+  vector<float> left( total ), right( total );
+  for ( size_t pos = 0; pos < total; pos += block_size ) {
+    synth.render( pos, { left.data() + pos, block_size }, { right.data() + pos, block_size } );
+  }
+  return left;
+}
+
+/* the same, with each event applied directly after rendering exactly up to its sample */
+vector<float> render_direct( const string& sample_directory,
+                             const vector<pair<size_t, MidiEvent>>& events,
+                             const size_t total )
+{
+  Synthesizer synth { sample_directory };
+  vector<float> left( total ), right( total );
+  size_t pos = 0;
+  for ( const auto& [sample, event] : events ) {
+    synth.render( pos, { left.data() + pos, sample - pos }, { right.data() + pos, sample - pos } );
+    pos = sample;
+    synth.process_new_data( event.type, event.note, event.velocity );
+  }
+  synth.render( pos, { left.data() + pos, total - pos }, { right.data() + pos, total - pos } );
+  return left;
+}
+
+/* Synthesizer::render splits its blocks on the samples events are scheduled for */
+void test_render_splitting()
+{
+  const SyntheticSamples samples { 0.25, 0.1 };
+  constexpr size_t block_size = 256, total = 16 * block_size;
+
+  /* a press partway through a block; its release (as a zero-velocity note-on) on a block boundary; an
+     off-keyboard note (dropped); and another press one sample before the end of a block */
+  const vector<pair<size_t, MidiEvent>> events { { 1000, note( KEY_DOWN, 60, 80 ) },
+                                                 { 1024, note( KEY_DOWN | 9, 10, 100 ) },
+                                                 { 2048, note( KEY_DOWN, 60, 0 ) },
+                                                 { 3071, note( KEY_DOWN | 3, 64, 40 ) } };
+
+  const vector<float> scheduled = render_scheduled( samples.directory(), events, block_size, total );
+  const vector<float> direct = render_direct( samples.directory(), events, total );
+
+  expect( all_of( scheduled.begin(), scheduled.begin() + 1000, []( const float x ) { return x == 0; } ),
+          "silence before the first note-on" );
+  expect( scheduled[1001] != 0, "sound right after the note-on" );
+
+  for ( size_t i = 0; i < total; i++ ) {
+    /* the passes are split differently, which can move a few ulp between the vector and scalar kernels */
+    expect( abs( scheduled[i] - direct[i] ) <= 1e-6, "sample " + to_string( i ) + " matches direct rendering" );
+  }
+
+  /* a zero-velocity note-on is a note-off */
+  vector<pair<size_t, MidiEvent>> with_note_off = events;
+  with_note_off[2].second = note( KEY_UP, 60, 0 );
+  expect( render_scheduled( samples.directory(), with_note_off, block_size, total ) == scheduled,
+          "note-on with velocity 0 sounds the same as note-off" );
+
+  /* an event scheduled for a sample already rendered is applied at the start of the next block, and counted */
+  Synthesizer synth { samples.directory() };
+  vector<float> left( block_size ), right( block_size );
+  synth.render( 0, { left.data(), block_size }, { right.data(), block_size } );
+  synth.schedule( 100, note( KEY_DOWN, 60, 80 ) );
+  synth.render( block_size, { left.data(), block_size }, { right.data(), block_size } );
+  expect( synth.active_voices() == 1, "late event applied" );
+  const string report = summary( *synth.event_schedule() );
+  expect( report.find( "late=1 (by up to 156 samples)" ) != string::npos, "summary: " + report );
+}
+
+void program_body()
+{
+  test_ordering();
+  test_render_splitting();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "audio_buffer.hh"
+#include "test_util.hh"
+
+using namespace std;
+
+/* interleave_s32() (AVX2/SSE2 when the compiler targets them) gives exactly what float_to_sample() gives, frame by
+   frame, for every length (so every vector body and tail) and at the edges of the range */
+void program_body()
+{
+  constexpr float scale = uint64_t( 1 ) << 31;
+
+  /* the edges: full scale (+1.0 can't be represented, so it clamps), past full scale, and halfway cases */
+  const vector<float> edges { 1.0,
+                              -1.0,
+                              nextafter( 1.0f, 0.0f ),
+                              nextafter( -1.0f, 0.0f ),
+                              1.5,
+                              -1.5,
+                              4.0,
+                              -4.0,
+                              0.0,
+                              -0.0,
+                              0.5 / scale,
+                              1.5 / scale,
+                              2.5 / scale,
+                              -0.5 / scale,
+                              -2.5 / scale,
+                              1e-20 };
+
+  expect( float_to_sample( 1.0 ) == INT32_MAX - 127, "+1.0 clamps to the largest float below 2^31" );
+  expect( float_to_sample( -1.0 ) == INT32_MIN, "-1.0 is the smallest S32" );
+
+  minstd_rand prng { 1 };
+  uniform_real_distribution<float> sample { -1.25, 1.25 };
+
+  for ( size_t count = 0; count <= 40; count++ ) {
+    for ( unsigned int trial = 0; trial < 8; trial++ ) {
+      vector<float> left( count ), right( count );
+      for ( size_t i = 0; i < count; i++ ) {
+        /* the first trials put every edge case in every lane */
+        left[i] = trial < 2 ? edges[( i + trial ) % edges.size()] : sample( prng );
+        right[i] = trial < 2 ? edges[( i + trial + 5 ) % edges.size()] : sample( prng );
+      }
+
+      vector<int32_t> out( 2 * count + 1, 12345 );
+      interleave_s32( left.data(), right.data(), count, out.data() );
+
+      for ( size_t i = 0; i < count; i++ ) {
+        const string where = " frame " + to_string( i ) + " of " + to_string( count );
+        expect( out[2 * i] == float_to_sample( left[i] ), "left" + where + " (" + to_string( left[i] ) + ")" );
+        expect( out[2 * i + 1] == float_to_sample( right[i] ), "right" + where + " (" + to_string( right[i] ) + ")" );
+      }
+      expect( out[2 * count] == 12345, "wrote past " + to_string( count ) + " frames" );
+    }
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "midi_processor.hh"
+#include "test_util.hh"
+
+using namespace std;
+using namespace std::string_literals;
+
+using Message = array<uint8_t, 3>; /* status, first data byte, second data byte */
+
+/* feed bytes to a parser in reads of read_size, taking the events as they come out */
+vector<Message> parse( MidiProcessor& parser, const string& bytes, const size_t read_size )
+{
+  vector<Message> messages;
+  for ( size_t i = 0; i < bytes.size(); i += read_size ) {
+    string_view chunk = string_view( bytes ).substr( i, read_size );
+    while ( not chunk.empty() or parser.has_event() ) {
+      parser.read_from_str( chunk );
+      while ( parser.has_event() ) {
+        messages.push_back( { parser.get_event_type(), parser.get_event_note(), parser.get_event_velocity() } );
+        parser.pop_event();
+      }
+    }
+  }
+  return messages;
+}
+
+/* the messages in a stream, parsed whole and (separately) one byte at a time, which must agree */
+vector<Message> parse( const string& bytes )
+{
+  MidiProcessor whole, bytewise;
+  const vector<Message> messages = parse( whole, bytes, bytes.size() );
+  expect( parse( bytewise, bytes, 1 ) == messages, "parsing byte by byte gives the same messages" );
+  return messages;
+}
+
+string describe( const vector<Message>& messages )
+{
+  string ret;
+  for ( const auto& [status, first, second] : messages ) {
+    ret += "(" + to_string( status ) + " " + to_string( first ) + " " + to_string( second ) + ")";
+  }
+  return ret;
+}
+
+void expect_messages( const string& bytes, const vector<Message>& expected, const string& what )
+{
+  const vector<Message> messages = parse( bytes );
+  expect( messages == expected, what + ": got " + describe( messages ) + ", expected " + describe( expected ) );
+}
+
+void program_body()
+{
+  expect_messages( "\x90\x3c\x40\x3e\x50\x40\x00"s,
+                   { { 0x90, 0x3c, 0x40 }, { 0x90, 0x3e, 0x50 }, { 0x90, 0x40, 0x00 } },
+                   "running status" );
+
+  expect_messages( "\x93\x3c\x40\x80\x3c\x40\x3e\x00"s,
+                   { { 0x93, 0x3c, 0x40 }, { 0x80, 0x3c, 0x40 }, { 0x80, 0x3e, 0x00 } },
+                   "a new status byte replaces the running status" );
+
+  expect_messages( "\xc5\x07\x08\xd1\x30"s, { { 0xc5, 0x07, 0 }, { 0xc5, 0x08, 0 }, { 0xd1, 0x30, 0 } },
+                   "one-data-byte messages, with running status" );
+
+  /* a note-on with velocity 0 is still a note-on to the parser (Synthesizer releases the key) */
+  expect_messages( "\x99\x24\x00"s, { { 0x99, 0x24, 0x00 } }, "note-on with velocity 0" );
+
+  expect_messages( "\xf8\x90\xf8\x3c\xfe\x40\xff\x3e\xf8\x50\xfa"s,
+                   { { 0x90, 0x3c, 0x40 }, { 0x90, 0x3e, 0x50 } },
+                   "realtime bytes inside messages" );
+
+  expect_messages( "\x90\x3c\x40\xf0\x7e\x00\x09\x01\xf7\x3e\x50\xb0\x40\x7f"s,
+                   { { 0x90, 0x3c, 0x40 }, { 0xb0, 0x40, 0x7f } },
+                   "SysEx is skipped, and cancels the running status" );
+
+  expect_messages( "\xf0\x01\x02\x90\x3c\x40"s, { { 0x90, 0x3c, 0x40 } }, "a status byte ends an unterminated SysEx" );
+
+  expect_messages( "\x90\x3c\x40\xf3\x05\x3e\x50\xf6"s,
+                   { { 0x90, 0x3c, 0x40 }, { 0xf3, 0x05, 0 }, { 0xf6, 0, 0 } },
+                   "system common messages (with and without data) cancel the running status" );
+
+  {
+    MidiProcessor parser;
+    parse( parser, "\x3c\x40\xf8\xf0\x01\x02\xf7\x90\x3c\x40"s, 3 );
+    expect( parser.stray_bytes() == 2, "data bytes before any status are counted as stray" );
+    expect( parser.realtime_bytes() == 1, "realtime bytes are counted" );
+    expect( parser.sysex_bytes() == 4, "SysEx bytes are counted" );
+  }
+
+  /* more events than the parser holds: parsing stops when they fill up, and resumes as they are popped */
+  string many = "\x90";
+  vector<Message> expected;
+  for ( unsigned int i = 0; i < 1000; i++ ) {
+    many += char( 21 + i % 88 );
+    many += char( 1 + i % 127 );
+    expected.push_back( { 0x90, uint8_t( 21 + i % 88 ), uint8_t( 1 + i % 127 ) } );
+  }
+  expect( parse( many ) == expected, "1000 messages in one read" );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "mix_kernel.hh"
+#include "test_util.hh"
+
+using namespace std;
+
+/* mix_layer() (AVX2/SSE2 when the compiler targets them) agrees with mix_layer_scalar() to within the few ulp that
+   fused multiply-adds can change, for every length (so every vector body and tail) and alignment */
+void program_body()
+{
+  minstd_rand prng { 1 };
+  uniform_real_distribution<float> sample { -1, 1 };
+
+  constexpr size_t max_frames = 67;
+  constexpr size_t max_offset = 7;
+  vector<float> left_src( max_frames + max_offset ), right_src( max_frames + max_offset );
+  vector<float> left_init( max_frames + max_offset ), right_init( max_frames + max_offset );
+
+  struct Gains
+  {
+    float layer_gain, gain, gain_step;
+  };
+
+  /* held; decaying; decaying to zero partway through (the clamp); silent */
+  for ( const Gains gains : { Gains { 0.43, 0.2, 0 },
+                              Gains { 1, 0.2, 0.00002 },
+                              Gains { 0.57, 0.001, 0.0001 },
+                              Gains { 1, 0, 0.0001 } } ) {
+    for ( size_t frames = 0; frames <= max_frames; frames++ ) {
+      for ( size_t offset = 0; offset <= max_offset; offset++ ) {
+        for ( auto* v : { &left_src, &right_src, &left_init, &right_init } ) {
+          generate( v->begin(), v->end(), [&] { return sample( prng ); } );
+        }
+
+        vector<float> left = left_init, right = right_init;
+        vector<float> left_expected = left_init, right_expected = right_init;
+
+        mix_layer( left_src.data() + offset,
+                   right_src.data() + offset,
+                   frames,
+                   gains.layer_gain,
+                   gains.gain,
+                   gains.gain_step,
+                   left.data() + offset,
+                   right.data() + offset );
+        mix_layer_scalar( left_src.data() + offset,
+                          right_src.data() + offset,
+                          frames,
+                          gains.layer_gain,
+                          gains.gain,
+                          gains.gain_step,
+                          left_expected.data() + offset,
+                          right_expected.data() + offset );
+
+        for ( size_t j = 0; j < left.size(); j++ ) {
+          const string where = "frame " + to_string( j ) + " of " + to_string( frames ) + " at offset "
+                               + to_string( offset ) + ", gain " + to_string( gains.gain );
+          /* outside the mixed range, nothing may change */
+          const bool mixed = j >= offset and j < offset + frames;
+          auto close = [&]( const float x, const float expected ) {
+            return abs( x - expected ) <= ( mixed ? 1e-6 * max( 1.0f, abs( expected ) ) : 0 );
+          };
+          expect( close( left[j], left_expected[j] ), "left " + where );
+          expect( close( right[j], right_expected[j] ), "right " + where );
+        }
+      }
+    }
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "synthesizer.hh"
+#include "synthetic_samples.hh"
+#include "test_util.hh"
+
+using namespace std;
+
+static constexpr uint8_t KEY_DOWN = 0x90;
+static constexpr uint8_t KEY_UP = 0x80;
+static constexpr uint8_t SUSTAIN = 0xb0;
+static constexpr uint8_t KEY_OFFSET = 21;
+static constexpr uint8_t NUM_KEYS = 88;
+
+static constexpr size_t block_size = 256;
+
+/* count every heap allocation made through operator new (which std containers and make_shared use) */
+static size_t allocation_count = 0;
+
+void* operator new( const size_t size )
+{
+  allocation_count++;
+  void* const ret = malloc( size );
+  return ret ? ret : throw bad_alloc();
+}
+
+void* operator new( const size_t size, const align_val_t alignment )
+{
+  allocation_count++;
+  const size_t align = size_t( alignment );
+  void* const ret = aligned_alloc( align, ( size + align - 1 ) & ~( align - 1 ) ); /* a multiple of the alignment */
+  return ret ? ret : throw bad_alloc();
+}
+
+void operator delete( void* const ptr ) noexcept
+{
+  free( ptr );
+}
+
+void operator delete( void* const ptr, const size_t ) noexcept
+{
+  free( ptr );
+}
+
+void operator delete( void* const ptr, const align_val_t ) noexcept
+{
+  free( ptr );
+}
+
+void operator delete( void* const ptr, const size_t, const align_val_t ) noexcept
+{
+  free( ptr );
+}
+
+/* render until every voice has finished */
+void render_out( Synthesizer& synth, vector<float>& left, vector<float>& right )
+{
+  do {
+    synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+  } while ( synth.active_voices() );
+}
+
+/* Nothing between a note-on and the end of the render that plays it may allocate: not the layer lookup, the voice
+   pool (even when it has to steal), the resampling or the event schedule */
+void program_body()
+{
+  const SyntheticSamples samples { 0.25, 0.05 };
+  vector<float> left( block_size ), right( block_size );
+
+  /* (reads the count before building the message, which allocates) */
+  auto expect_no_allocations = []( const size_t before, const char* what ) {
+    const size_t allocations = allocation_count - before;
+    expect( allocations == 0,
+            to_string( allocations ) + " heap allocations between note-on and the end of " + what );
+  };
+
+  {
+    Synthesizer synth { samples.directory() };
+
+    /* every key (a third of them resampled from a neighbour), at velocities in and between the crossfade zones,
+       then their releases, with the sustain pedal down for some, and notes no key plays */
+    size_t before = allocation_count;
+    for ( uint8_t key = 0; key < NUM_KEYS; key++ ) {
+      synth.process_new_data( KEY_DOWN, KEY_OFFSET + key, 1 + ( key * 29 ) % 127 );
+    }
+    synth.process_new_data( KEY_DOWN | 9, 10, 100 );
+    synth.process_new_data( SUSTAIN, 64, 127 );
+    render_out( synth, left, right );
+    for ( uint8_t key = 0; key < NUM_KEYS; key++ ) {
+      synth.process_new_data( KEY_DOWN, KEY_OFFSET + key, 90 );
+      synth.process_new_data( key % 2 ? KEY_UP : KEY_DOWN, KEY_OFFSET + key, 0 );
+    }
+    synth.process_new_data( SUSTAIN, 64, 0 );
+    render_out( synth, left, right );
+    expect_no_allocations( before, "rendering note-ons and note-offs" );
+
+    /* the same through the event schedule, which splits blocks on the events' samples */
+    before = allocation_count;
+    const size_t start = synth.frames_processed_count();
+    for ( uint8_t key = 0; key < NUM_KEYS; key++ ) {
+      synth.schedule( start + 37 * key, { KEY_DOWN, uint8_t( KEY_OFFSET + key ), 64 } );
+      synth.schedule( start + 37 * key + 500, { KEY_UP, uint8_t( KEY_OFFSET + key ), 0 } );
+    }
+    render_out( synth, left, right );
+    expect_no_allocations( before, "rendering scheduled events" );
+  }
+
+  {
+    /* more notes than voices: stealing must not allocate either */
+    Synthesizer synth { samples.directory(), 16 };
+    const size_t before = allocation_count;
+    for ( unsigned int round = 0; round < 4; round++ ) {
+      for ( uint8_t key = 0; key < NUM_KEYS; key++ ) {
+        synth.process_new_data( KEY_DOWN, KEY_OFFSET + key, 80 );
+      }
+      synth.render( synth.frames_processed_count(), { left.data(), block_size }, { right.data(), block_size } );
+    }
+    render_out( synth, left, right );
+    expect_no_allocations( before, "rendering with voice stealing" );
+    expect( synth.voices_stolen() > 0, "voices were stolen" );
+  }
+
+  expect( allocation_count > 0, "the allocation counter works" );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "slot_map.hh"
+#include "test_util.hh"
+
+using namespace std;
+
+vector<string> contents( SlotMap<string>& map )
+{
+  return { map.begin(), map.end() };
+}
+
+void program_body()
+{
+  SlotMap<string> map { 4 };
+
+  const SlotKey a = map.emplace( "a" );
+  const SlotKey b = map.emplace( "b" );
+  const SlotKey c = map.emplace( "c" );
+  expect( map.size() == 3 and contents( map ) == vector<string> { "a", "b", "c" }, "insertion order" );
+  expect( map.find( b ) and *map.find( b ) == "b", "find" );
+  expect( not map.find( SlotKey {} ), "a default key finds nothing" );
+
+  /* erasing keeps the rest in order, and the keys of the values after it still work */
+  auto after = map.erase( map.begin() + 1 );
+  expect( after != map.end() and *after == "c", "erase returns the following value" );
+  expect( contents( map ) == vector<string> { "a", "c" }, "order after erase" );
+  expect( not map.find( b ), "an erased value's key finds nothing" );
+  expect( map.find( a ) and *map.find( a ) == "a", "key before the erased value" );
+  expect( map.find( c ) and *map.find( c ) == "c", "key after the erased value" );
+
+  /* the slot is reused, but the old key still finds nothing */
+  const SlotKey d = map.emplace( "d" );
+  expect( d.index == b.index and d.generation != b.generation, "a freed slot is reused with a new generation" );
+  expect( not map.find( b ), "a stale key finds nothing after its slot is reused" );
+  expect( map.find( d ) and *map.find( d ) == "d", "the reused slot's new key" );
+  expect( contents( map ) == vector<string> { "a", "c", "d" }, "a reused slot's value goes at the end" );
+
+  /* key() gives back the key of a value found by iterating */
+  for ( auto it = map.begin(); it != map.end(); ++it ) {
+    const SlotKey key = map.key( it );
+    expect( map.find( key ) == &*it, "key( it ) finds " + *it );
+  }
+
+  /* erase and reuse the same slot many times: only the newest key works */
+  SlotKey previous = d;
+  for ( unsigned int i = 0; i < 1000; i++ ) {
+    for ( auto it = map.begin(); it != map.end(); ++it ) {
+      if ( map.find( previous ) == &*it ) {
+        map.erase( it );
+        break;
+      }
+    }
+    const SlotKey next = map.emplace( to_string( i ) );
+    expect( not map.find( previous ), "stale key after " + to_string( i ) + " reuses" );
+    expect( map.find( next ) and *map.find( next ) == to_string( i ), "new key after reuse" );
+    expect( not map.find( b ) and not map.find( d ), "older stale keys" );
+    previous = next;
+  }
+  expect( map.size() == 3, "size after reuses" );
+
+  /* capacity is fixed */
+  map.emplace( "e" );
+  bool threw = false;
+  try {
+    map.emplace( "f" );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "emplace into a full SlotMap throws" );
+  expect( map.size() == 4, "size when full" );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+#include "test_util.hh"
+#include "typed_ring_buffer.hh"
+
+using namespace std;
+
+/* one thread alone: full and empty, and wrapping around the end of the storage */
+void test_single_thread( const size_t elements )
+{
+  SPSCRingBuffer<uint64_t> buffer { elements };
+  expect( buffer.capacity() == elements, "capacity" );
+
+  expect( buffer.readable_region().size() == 0, "new buffer is empty" );
+  expect( buffer.writable_region().size() == elements, "new buffer is all writable" );
+
+  uint64_t next_push = 0, next_pop = 0;
+  for ( size_t i = 0; i < elements; i++ ) {
+    expect( buffer.try_push( next_push++ ), "push into a buffer with room" );
+  }
+  expect( not buffer.try_push( next_push ), "push into a full buffer fails" );
+  expect( buffer.writable_region().size() == 0 and buffer.num_stored() == elements, "full" );
+
+  bool threw = false;
+  try {
+    buffer.push( 1 );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "push past the writable region throws" );
+
+  /* take n elements, checking their order (the consumer may see them in more than one region, since it only
+     looks at the producer's count again once it has used up the elements it knew about) */
+  auto pop_in_order = [&]( size_t n ) {
+    while ( n ) {
+      const auto readable = buffer.readable_region();
+      expect( readable.size() > 0, "stored elements are readable" );
+      const size_t batch = min( n, readable.size() );
+      for ( size_t i = 0; i < batch; i++ ) {
+        expect( readable[i] == next_pop++, "elements come out in order" );
+      }
+      buffer.pop( batch );
+      n -= batch;
+    }
+  };
+
+  /* drain about a third, then refill, so the regions wrap around the end of the storage (contiguously) */
+  for ( unsigned int round = 0; round < 10; round++ ) {
+    const size_t to_pop = elements / 3 + round;
+    pop_in_order( to_pop );
+
+    auto writable = buffer.writable_region();
+    expect( writable.size() == to_pop, "popped elements are writable again" );
+    for ( size_t i = 0; i < writable.size(); i++ ) {
+      writable[i] = next_push++;
+    }
+    buffer.push( writable.size() );
+  }
+
+  /* empty it */
+  pop_in_order( elements );
+  expect( buffer.readable_region().size() == 0 and buffer.num_stored() == 0, "empty" );
+  expect( next_pop == next_push, "everything pushed came out" );
+
+  threw = false;
+  try {
+    buffer.pop( 1 );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "pop from an empty buffer throws" );
+}
+
+/* a producer and a consumer on their own threads, in uneven batches, through a small buffer that is often full
+   and often empty: every element arrives once, in order */
+void test_two_threads( const size_t elements )
+{
+  constexpr uint64_t count = 500'000;
+  SPSCRingBuffer<uint64_t> buffer { elements };
+
+  uint64_t producer_found_full = 0;
+  thread producer( [&] {
+    uint64_t next = 0, batch = 1;
+    while ( next < count ) {
+      auto region = buffer.writable_region();
+      if ( region.size() == 0 ) {
+        producer_found_full++;
+        this_thread::yield(); /* (so this passes on one CPU too) */
+      }
+      const size_t n = min( { region.size(), size_t( batch ), size_t( count - next ) } );
+      for ( size_t i = 0; i < n; i++ ) {
+        region[i] = next++;
+      }
+      buffer.push( n );
+      batch = batch % 97 + 1;
+    }
+  } );
+
+  uint64_t expected = 0, batch = 1, consumer_found_empty = 0;
+  bool in_order = true;
+  while ( expected < count ) {
+    const auto region = buffer.readable_region();
+    if ( region.size() == 0 ) {
+      consumer_found_empty++;
+      this_thread::yield();
+    }
+    const size_t n = min( region.size(), size_t( batch ) );
+    for ( size_t i = 0; i < n; i++ ) {
+      in_order &= region[i] == expected++;
+    }
+    buffer.pop( n );
+    batch = batch % 89 + 1;
+  }
+  producer.join();
+
+  expect( in_order, "every element arrives in order" );
+  expect( buffer.readable_region().size() == 0, "nothing left over" );
+  expect( buffer.num_pushed() == count and buffer.num_popped() == count, "counts" );
+
+  /* with half a million elements through a one-page buffer, each side gets ahead of the other many times */
+  expect( producer_found_full > 0, "the producer found the buffer full, and carried on once there was room" );
+  expect( consumer_found_empty > 0, "the consumer found the buffer empty, and carried on once there was more" );
+}
+
+void program_body()
+{
+  /* the smallest buffer: one page */
+  const size_t elements = sysconf( _SC_PAGESIZE ) / sizeof( uint64_t );
+  test_single_thread( elements );
+  test_two_threads( elements );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
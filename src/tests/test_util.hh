@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+/* a failed check ends the test: main() prints what failed and exits with EXIT_FAILURE */
+inline void expect( const bool condition, const std::string& what )
+{
+  if ( not condition ) {
+    throw std::runtime_error( "check failed: " + what );
+  }
+}
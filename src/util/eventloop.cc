@@ -3,17 +3,67 @@
 #include "socket.hh"
 #include "timer.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 using namespace std;
 
-EventLoop::EventLoop()
-  : _rule_categories()
+EventLoop::EventLoop( const Backend backend )
+  : _backend( backend )
+  , _rule_categories()
+  , _woke_ns( Timer::timestamp_ns() )
 {
   _rule_categories.reserve( 64 );
   // prevent _rule_categories from being reallocated in middle of wait_next_event
   // (if a rule adds a new category)
+
+  if ( _backend == Backend::Epoll ) {
+    _epoll.emplace( CheckSystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) );
+  }
+
+  if ( _backend == Backend::IoUring ) {
+    try {
+      _uring.emplace( uring_entries );
+    } catch ( const runtime_error& ) {
+      /* an old kernel, or io_uring is disabled (by sysctl or seccomp) */
+      _backend = Backend::Poll;
+    }
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  if ( not _uring.has_value() ) {
+    return;
+  }
+
+  /* a request still with the kernel could write into a rule's buffer after this */
+  try {
+    size_t in_flight = 0;
+    for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ++it ) {
+      if ( it->in_flight ) {
+        io_uring_sqe& request = _uring->prepare();
+        request.opcode = IORING_OP_ASYNC_CANCEL;
+        request.fd = -1;
+        request.addr = encode_key( _fd_rules.key( it ) );
+        request.user_data = no_rule;
+        in_flight++;
+      }
+    }
+
+    while ( in_flight ) {
+      _uring->submit_and_wait( 1, -1 );
+      _uring->drain_completions( [&]( const io_uring_cqe& completion ) {
+        in_flight -= _fd_rules.find( decode_key( completion.user_data ) ) != nullptr;
+      } );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception destructing EventLoop: " << e.what() << endl;
+  }
 }
 
 unsigned int EventLoop::FDRule::service_count() const
@@ -66,10 +116,14 @@ EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
     throw out_of_range( "bad category_id" );
   }
 
-  _fd_rules.emplace_back( make_shared<FDRule>(
-    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, recover ) );
+  if ( _fd_rules.size() >= max_rules ) {
+    throw runtime_error( "maximum rules reached" );
+  }
 
-  return _fd_rules.back();
+  return { *this,
+           true,
+           _fd_rules.emplace(
+             BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, recover ) };
 }
 
 EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
@@ -80,81 +134,314 @@ EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
     throw out_of_range( "bad category_id" );
   }
 
-  _non_fd_rules.emplace_back( make_shared<BasicRule>( category_id, interest, callback ) );
+  if ( _non_fd_rules.size() >= max_rules ) {
+    throw runtime_error( "maximum rules reached" );
+  }
 
-  return _non_fd_rules.back();
+  return { *this, false, _non_fd_rules.emplace( category_id, interest, callback ) };
+}
+
+SlotKey EventLoop::add_timer( const size_t category_id,
+                              const chrono::steady_clock::time_point first,
+                              const chrono::nanoseconds period,
+                              const CallbackT& callback )
+{
+  /* steady_clock is CLOCK_MONOTONIC */
+  FileDescriptor timer {
+    CheckSystemCall( "timerfd_create", timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) };
+  timer.set_blocking( false );
+
+  auto to_timespec = []( const chrono::nanoseconds ns ) {
+    return timespec { time_t( ns.count() / 1000000000 ), long( ns.count() % 1000000000 ) };
+  };
+
+  /* an all-zero expiration would disarm the timer */
+  const itimerspec schedule { to_timespec( period ),
+                              to_timespec( max( first.time_since_epoch(), chrono::nanoseconds( 1 ) ) ) };
+  CheckSystemCall( "timerfd_settime", timerfd_settime( timer.fd_num(), TFD_TIMER_ABSTIME, &schedule, nullptr ) );
+
+  const RuleHandle handle = add_rule( category_id, timer, Direction::In, callback );
+  FDRule& rule = *_fd_rules.find( handle.key_ );
+  rule.timer = true;
+  rule.once = period == chrono::nanoseconds::zero();
+
+  return handle.key_;
+}
+
+EventLoop::RuleHandle EventLoop::add_read_rule( const size_t category_id,
+                                                const FileDescriptor& fd,
+                                                RingBuffer& buffer,
+                                                const CallbackT& callback,
+                                                const CallbackT& cancel )
+{
+  const RingBuffer* const room = &buffer;
+  const RuleHandle handle = add_rule(
+    category_id, fd, Direction::In, callback, [room] { return room->writable_region().size() > 0; }, cancel );
+  _fd_rules.find( handle.key_ )->read_into = &buffer;
+
+  return handle;
+}
+
+EventLoop::RuleHandle EventLoop::add_timer_rule( const size_t category_id,
+                                                 const chrono::nanoseconds period,
+                                                 const CallbackT& callback )
+{
+  if ( period <= chrono::nanoseconds::zero() ) {
+    throw runtime_error( "EventLoop::add_timer_rule: period must be positive" );
+  }
+
+  return { *this, true, add_timer( category_id, chrono::steady_clock::now() + period, period, callback ) };
+}
+
+EventLoop::RuleHandle EventLoop::add_timer_rule( const size_t category_id,
+                                                 const chrono::steady_clock::time_point deadline,
+                                                 const CallbackT& callback )
+{
+  return { *this, true, add_timer( category_id, deadline, chrono::nanoseconds::zero(), callback ) };
+}
+
+EventLoop::BasicRule* EventLoop::RuleHandle::rule() const
+{
+  if ( fd_rule_ ) {
+    return loop_->_fd_rules.find( key_ );
+  } else {
+    return loop_->_non_fd_rules.find( key_ );
+  }
 }
 
 void EventLoop::RuleHandle::cancel()
 {
-  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
-  if ( rule_shared_ptr ) {
-    rule_shared_ptr->cancel_requested = true;
+  BasicRule* const rule_ptr = rule();
+  if ( rule_ptr ) {
+    rule_ptr->cancel_requested = true;
+  }
+}
+
+EventLoop::RuleHandle& EventLoop::RuleHandle::set_priority( const Priority priority )
+{
+  BasicRule* const rule_ptr = rule();
+  if ( rule_ptr ) {
+    rule_ptr->priority = priority;
+  }
+  return *this;
+}
+
+EventLoop::RuleHandle& EventLoop::RuleHandle::set_deadline( const chrono::nanoseconds deadline )
+{
+  BasicRule* const rule_ptr = rule();
+  if ( rule_ptr ) {
+    rule_ptr->deadline = deadline;
   }
+  return *this;
 }
 
 EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 {
-  // first, handle the non-file-descriptor-related rules
-  {
-    for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
-      auto& this_rule = **it;
-      bool rule_fired = false;
+  bool served = false;
+  /* the first interested best-effort rule without an fd; if there is one, it goes instead of any best-effort fd
+     rule, whatever the order they were added in */
+  BasicRule* best_effort = nullptr;
 
-      if ( this_rule.cancel_requested ) {
-        it = _non_fd_rules.erase( it );
-        continue;
-      }
+  // first, serve the real-time rules that aren't waiting on a file descriptor
+  for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
+    auto& this_rule = *it;
 
-      uint16_t iterations = 0;
-      while ( this_rule.interest() ) {
-        if ( iterations++ > 32768 ) {
-          throw runtime_error( "EventLoop: busy wait detected: rule \""
-                               + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
-                               + to_string( iterations ) + " iterations" );
-        }
+    if ( this_rule.cancel_requested ) {
+      it = _non_fd_rules.erase( it );
+      continue;
+    }
 
-        rule_fired = true;
-        RecordScopeTimer<Timer::Category::Nonblock> record_timer {
-          _rule_categories.at( this_rule.category_id ).timer
-        };
-        this_rule.callback();
+    if ( this_rule.priority == Priority::RealTime ) {
+      if ( this_rule.interest() ) {
+        serve_until_satisfied( this_rule, mark_ready( this_rule ) );
+        served = true;
       }
-
-      if ( rule_fired ) {
-        return Result::Success; /* only serve one rule on each iteration */
+    } else if ( not best_effort or this_rule.deadline ) {
+      /* (a best-effort rule with a deadline is checked even when it can't go this time, so that its wait counts
+         from the first wakeup that found it interested) */
+      if ( this_rule.interest() ) {
+        mark_ready( this_rule );
+        best_effort = best_effort ? best_effort : &this_rule;
+      } else {
+        this_rule.ready_ns = 0;
       }
+    }
 
-      ++it;
+    ++it;
+  }
+
+  // now the file-descriptor-related rules (without waiting, if anything above is ready)
+  _ready.clear();
+  const int timeout = ( served or best_effort ) ? 0 : timeout_ms;
+  const Result result = _backend == Backend::Poll    ? wait_with_poll( timeout )
+                        : _backend == Backend::Epoll ? wait_with_epoll( timeout )
+                                                     : wait_with_io_uring( timeout );
+  const uint64_t ready_ns = Timer::timestamp_ns();
+  _woke_ns = ready_ns;
+
+  // every ready real-time rule (that's still interested after the ones before it ran)
+  for ( FDRule* const rule : _ready ) {
+    if ( rule->priority == Priority::RealTime and wants_service( *rule ) ) {
+      serve( *rule, ready_ns );
+      served = true;
     }
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
-  vector<pollfd> pollfds {};
-  pollfds.reserve( _fd_rules.size() );
-  bool something_to_poll = false;
+  // then one best-effort rule (one without an fd first)
+  if ( best_effort ) {
+    if ( not best_effort->cancel_requested and best_effort->interest() ) {
+      serve_until_satisfied( *best_effort, best_effort->ready_ns );
+    }
+    return Result::Success;
+  }
 
-  // set up the pollfd for each rule
-  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
-    auto& this_rule = **it;
+  for ( FDRule* const rule : _ready ) {
+    if ( rule->priority == Priority::BestEffort and wants_service( *rule ) ) {
+      serve( *rule, ready_ns );
+      return Result::Success;
+    }
+  }
 
-    if ( this_rule.cancel_requested ) {
-      //      this_rule.cancel();
-      //      if rule is cancelled externally, no need to call the cancellation callback
-      //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
-      continue;
+  return served ? Result::Success : result;
+}
+
+bool EventLoop::defunct( FDRule& rule )
+{
+  if ( rule.cancel_requested ) {
+    //      rule.cancel();
+    //      if rule is cancelled externally, no need to call the cancellation callback
+    //      this makes it easier to cancel rules and delete captured objects right away
+    return true;
+  }
+
+  if ( rule.direction == Direction::In && rule.fd.eof() ) {
+    // no more reading on this rule, it's reached eof
+    rule.cancel();
+    return true;
+  }
+
+  if ( rule.fd.closed() ) {
+    rule.cancel();
+    return true;
+  }
+
+  return false;
+}
+
+void EventLoop::report_error( const FDRule& rule ) const
+{
+  /* see if fd is a socket */
+  int socket_error = 0;
+  socklen_t optlen = sizeof( socket_error );
+  const int ret = getsockopt( rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+  if ( ret == -1 and errno == ENOTSOCK ) {
+    cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( rule.category_id ).name << "\"\n";
+  } else if ( ret == -1 ) {
+    throw unix_error( "getsockopt" );
+  } else if ( optlen != sizeof( socket_error ) ) {
+    throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+  } else if ( socket_error ) {
+    cerr << "error on polled socket for rule \"" << _rule_categories.at( rule.category_id ).name
+         << "\": " << strerror( socket_error ) << "\n";
+  }
+}
+
+bool EventLoop::wants_service( FDRule& rule )
+{
+  return not rule.cancel_requested and ( rule.read_completed or rule.interest() );
+}
+
+void EventLoop::serve( FDRule& rule, const uint64_t ready_ns )
+{
+  {
+    RecordScopeTimer<Timer::Category::Nonblock> record_timer { _rule_categories.at( rule.category_id ).timer };
+    // we only want to call callback if revents includes the event we asked for
+    const auto count_before = rule.service_count();
+
+    if ( rule.timer ) {
+      uint64_t expirations;
+      if ( rule.fd.read( { reinterpret_cast<char*>( &expirations ), sizeof( expirations ) } ) == 0 ) {
+        return; /* not expired after all */
+      }
     }
 
-    if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
-      // no more reading on this rule, it's reached eof
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
-      continue;
+    /* with Backend::IoUring, the read has already happened */
+    if ( rule.read_into and not rule.read_completed ) {
+      rule.read_into->push_from_fd( rule.fd );
     }
+    rule.read_completed = false;
 
-    if ( this_rule.fd.closed() ) {
-      this_rule.cancel();
+    rule.callback();
+
+    if ( rule.once ) {
+      rule.cancel_requested = true;
+    }
+
+    /* (a read rule's callback only consumes what the loop read) */
+    if ( count_before == rule.service_count() and ( not rule.fd.closed() ) and ( not rule.read_into )
+         and rule.interest() ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \"" + _rule_categories.at( rule.category_id ).name
+                           + "\" did not read/write fd and is still interested" );
+    }
+  }
+
+  record_deadline( rule, ready_ns );
+}
+
+void EventLoop::serve_until_satisfied( BasicRule& rule, const uint64_t ready_ns )
+{
+  uint16_t iterations = 0;
+  do {
+    if ( iterations++ > 32768 ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \"" + _rule_categories.at( rule.category_id ).name
+                           + "\" is still interested after " + to_string( iterations ) + " iterations" );
+    }
+
+    RecordScopeTimer<Timer::Category::Nonblock> record_timer { _rule_categories.at( rule.category_id ).timer };
+    rule.callback();
+  } while ( rule.interest() );
+
+  record_deadline( rule, ready_ns );
+  rule.ready_ns = 0;
+}
+
+uint64_t EventLoop::mark_ready( BasicRule& rule ) const
+{
+  if ( rule.deadline and not rule.ready_ns ) {
+    rule.ready_ns = _woke_ns;
+  }
+  return rule.ready_ns;
+}
+
+void EventLoop::record_deadline( const BasicRule& rule, const uint64_t ready_ns )
+{
+  if ( not rule.deadline.has_value() ) {
+    return;
+  }
+
+  auto& record = _deadlines.at( static_cast<size_t>( rule.priority ) );
+  const uint64_t elapsed_ns = Timer::timestamp_ns() - ready_ns;
+  const uint64_t deadline_ns = rule.deadline->count();
+
+  record.served++;
+  if ( elapsed_ns > deadline_ns ) {
+    record.missed++;
+    record.max_late_ns = max( record.max_late_ns, elapsed_ns - deadline_ns );
+  }
+}
+
+EventLoop::Result EventLoop::wait_with_poll( const int timeout_ms )
+{
+  // poll any "interested" file descriptors
+  auto& pollfds = _pollfds;
+  pollfds.clear();
+  bool something_to_poll = false;
+
+  // set up the pollfd for each rule
+  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
+    auto& this_rule = *it;
+
+    if ( defunct( this_rule ) ) {
       it = _fd_rules.erase( it );
       continue;
     }
@@ -182,38 +469,23 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
   }
 
   // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), size_t( 0 ) ); it != _fd_rules.end(); ++idx ) {
+  // (rules aren't erased here, so that the ones already found ready stay put; a retired rule goes next time)
+  for ( auto [it, idx] = make_pair( _fd_rules.begin(), size_t( 0 ) ); it != _fd_rules.end(); ++it, ++idx ) {
     const auto& this_pollfd = pollfds.at( idx );
-    auto& this_rule = **it;
+    auto& this_rule = *it;
 
     const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
     if ( poll_error ) {
       /* recoverable error? */
       if ( not static_cast<bool>( this_pollfd.revents & POLLNVAL ) ) {
         if ( this_rule.recover() ) {
-          ++it;
           continue;
         }
       }
 
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
-
+      report_error( this_rule );
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      this_rule.cancel_requested = true;
       continue;
     }
 
@@ -224,31 +496,299 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
       //   - if it was POLLIN and nothing is readable, no more will ever be readable
       //   - if it was POLLOUT, it will not be writable again
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      this_rule.cancel_requested = true;
       continue;
     }
 
     if ( poll_ready ) {
-      RecordScopeTimer<Timer::Category::Nonblock> record_timer {
-        _rule_categories.at( this_rule.category_id ).timer
-      };
-      // we only want to call callback if revents includes the event we asked for
-      const auto count_before = this_rule.service_count();
-      this_rule.callback();
-
-      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
-        throw runtime_error( "EventLoop: busy wait detected: rule \""
-                             + _rule_categories.at( this_rule.category_id ).name
-                             + "\" did not read/write fd and is still interested" );
+      _ready.push_back( &this_rule );
+    }
+  }
+
+  return Result::Success;
+}
+
+void EventLoop::update_registration( FDRule& rule, const SlotKey key, const bool interested )
+{
+  if ( rule.always_ready or ( rule.registration.has_value() and rule.registered_interest == interested ) ) {
+    return;
+  }
+
+  epoll_event event {};
+  /* errors are reported regardless */
+  event.events = interested ? uint32_t( rule.direction == Direction::In ? EPOLLIN : EPOLLOUT ) : 0;
+  event.data.u64 = encode_key( key );
+
+  if ( rule.registration.has_value() ) {
+    CheckSystemCall( "epoll_ctl(MOD)",
+                     epoll_ctl( _epoll->fd_num(), EPOLL_CTL_MOD, rule.registration->fd_num(), &event ) );
+  } else {
+    FileDescriptor registration { CheckSystemCall( "dup", dup( rule.fd.fd_num() ) ) };
+    if ( epoll_ctl( _epoll->fd_num(), EPOLL_CTL_ADD, registration.fd_num(), &event ) < 0 ) {
+      if ( errno != EPERM ) {
+        throw unix_error( "epoll_ctl(ADD)" );
       }
 
-      return Result::Success; /* only serve one rule on each iteration */
+      /* epoll refuses regular files, which poll(2) reports as always ready */
+      rule.always_ready = true;
+      return;
     }
+    rule.registration.emplace( move( registration ) );
+  }
+
+  rule.registered_interest = interested;
+}
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+void EventLoop::unregister( FDRule& rule )
+{
+  if ( rule.registration.has_value() ) {
+    CheckSystemCall( "epoll_ctl(DEL)",
+                     epoll_ctl( _epoll->fd_num(), EPOLL_CTL_DEL, rule.registration->fd_num(), nullptr ) );
+    rule.registration.reset();
   }
+}
 
-  return Result::Success;
+EventLoop::Result EventLoop::wait_with_epoll( const int timeout_ms )
+{
+  bool something_to_poll = false;
+  bool always_ready = false; /* an interested rule that epoll can't watch */
+
+  // bring each rule's registration up to date: a system call only for a rule whose interest has changed
+  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
+    auto& this_rule = *it;
+
+    if ( defunct( this_rule ) ) {
+      unregister( this_rule );
+      it = _fd_rules.erase( it );
+      continue;
+    }
+
+    const bool interested = this_rule.interest();
+    update_registration( this_rule, _fd_rules.key( it ), interested );
+    something_to_poll |= interested;
+    if ( interested and this_rule.always_ready ) {
+      always_ready = true;
+      _ready.push_back( &this_rule );
+    }
+    ++it;
+  }
+
+  // quit if there is nothing left to poll
+  if ( not something_to_poll ) {
+    return Result::Exit;
+  }
+
+  _epoll_events.resize( max( _epoll_events.size(), _fd_rules.size() ) );
+
+  int ready_count;
+  {
+    RecordScopeTimer<Timer::Category::WaitingForEvent> record_timer { _waiting };
+    ready_count = CheckSystemCall(
+      "epoll_wait",
+      epoll_wait( _epoll->fd_num(), _epoll_events.data(), _epoll_events.size(), always_ready ? 0 : timeout_ms ) );
+  }
+
+  // go through the ready rules only
+  for ( auto event = _epoll_events.begin(); event != _epoll_events.begin() + ready_count; ++event ) {
+    FDRule* const rule = _fd_rules.find( decode_key( event->data.u64 ) );
+    if ( not rule ) {
+      continue;
+    }
+    auto& this_rule = *rule;
+
+    if ( event->events & EPOLLERR ) {
+      /* recoverable error? */
+      if ( this_rule.recover() ) {
+        continue;
+      }
+
+      report_error( this_rule );
+      this_rule.cancel();
+      unregister( this_rule );
+      this_rule.cancel_requested = true; /* erased next time */
+      continue;
+    }
+
+    const bool epoll_ready = event->events & ( EPOLLIN | EPOLLOUT );
+    if ( ( event->events & EPOLLHUP ) and this_rule.registered_interest and not epoll_ready ) {
+      // as with poll: if the _only_ condition was a hangup, this FD is defunct
+      this_rule.cancel();
+      unregister( this_rule );
+      this_rule.cancel_requested = true; /* erased next time */
+      continue;
+    }
+
+    if ( epoll_ready ) {
+      _ready.push_back( &this_rule );
+    }
+  }
+
+  // in the order they were added (like the poll backend), which is the order they're stored in
+  sort( _ready.begin(), _ready.end() );
+
+  return ( ready_count or always_ready ) ? Result::Success : Result::Timeout;
+}
+
+EventLoop::Result EventLoop::wait_with_io_uring( const int timeout_ms )
+{
+  bool something_to_wait_for = false;
+  bool completed = false; /* a read rule has data its callback hasn't seen */
+
+  // make sure each interested rule has a request with the kernel
+  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
+    auto& this_rule = *it;
+
+    if ( defunct( this_rule ) ) {
+      if ( not this_rule.in_flight ) {
+        it = _fd_rules.erase( it );
+        continue;
+      }
+
+      /* the kernel could still write into the rule's buffer: erase the rule once its request comes back */
+      this_rule.cancel_requested = true;
+      if ( not this_rule.cancel_submitted ) {
+        io_uring_sqe& request = _uring->prepare();
+        request.opcode = IORING_OP_ASYNC_CANCEL;
+        request.fd = -1;
+        request.addr = encode_key( _fd_rules.key( it ) );
+        request.user_data = no_rule;
+        this_rule.cancel_submitted = true;
+      }
+      ++it;
+      continue;
+    }
+
+    if ( this_rule.read_completed ) {
+      /* (the next read waits until the callback has had this one) */
+      completed = true;
+      _ready.push_back( &this_rule );
+    } else if ( this_rule.interest() ) {
+      something_to_wait_for = true;
+      if ( not this_rule.in_flight ) {
+        submit( this_rule, _fd_rules.key( it ) );
+      }
+    }
+    ++it;
+  }
+
+  // quit if there is nothing left to wait for
+  if ( not something_to_wait_for and not completed ) {
+    return Result::Exit;
+  }
+
+  // one system call submits the new requests and waits for results
+  {
+    RecordScopeTimer<Timer::Category::WaitingForEvent> record_timer { _waiting };
+    _uring->submit_and_wait( ( completed or timeout_ms == 0 ) ? 0 : 1, timeout_ms );
+  }
+
+  _uring->drain_completions( [&]( const io_uring_cqe& completion ) { complete( completion ); } );
+
+  // in the order they were added, as with the other backends
+  sort( _ready.begin(), _ready.end() );
+
+  return _ready.empty() ? Result::Timeout : Result::Success;
+}
+
+void EventLoop::submit( FDRule& rule, const SlotKey key )
+{
+  if ( rule.read_into ) {
+    if ( rule.poll_first ) {
+      /* linked: the read starts once the poll completes */
+      io_uring_sqe& poll = _uring->prepare();
+      poll.opcode = IORING_OP_POLL_ADD;
+      poll.fd = rule.fd.fd_num();
+      poll.poll32_events = POLLIN;
+      poll.flags = IOSQE_IO_LINK;
+      poll.user_data = no_rule;
+      rule.poll_first = false;
+    }
+
+    string_span region = rule.read_into->writable_region();
+    io_uring_sqe& read = _uring->prepare();
+    read.opcode = IORING_OP_READ;
+    read.fd = rule.fd.fd_num();
+    read.addr = reinterpret_cast<uint64_t>( region.mutable_data() );
+    read.len = region.size();
+    read.off = -1; /* at the file's position, as read(2) would */
+    read.user_data = encode_key( key );
+  } else {
+    /* a one-shot poll, whose result is the revents */
+    io_uring_sqe& poll = _uring->prepare();
+    poll.opcode = IORING_OP_POLL_ADD;
+    poll.fd = rule.fd.fd_num();
+    poll.poll32_events = static_cast<uint16_t>( rule.direction );
+    poll.user_data = encode_key( key );
+  }
+
+  rule.in_flight = true;
+}
+
+void EventLoop::complete( const io_uring_cqe& completion )
+{
+  FDRule* const rule = _fd_rules.find( decode_key( completion.user_data ) );
+  if ( not rule ) {
+    return; /* no_rule */
+  }
+  auto& this_rule = *rule;
+  this_rule.in_flight = false;
+
+  if ( this_rule.cancel_requested or completion.res == -ECANCELED or completion.res == -EINTR ) {
+    return; /* retired (and erased next time), or asked again next time */
+  }
+
+  if ( this_rule.read_into and completion.res >= 0 ) {
+    if ( completion.res == 0 ) {
+      // EOF: no more reading on this rule
+      this_rule.cancel();
+      this_rule.cancel_requested = true;
+      return;
+    }
+
+    this_rule.read_into->push( completion.res );
+    this_rule.read_completed = true;
+    _ready.push_back( &this_rule );
+    return;
+  }
+
+  if ( this_rule.read_into and completion.res == -EAGAIN ) {
+    this_rule.poll_first = true;
+    return;
+  }
+
+  /* a failed read, or a poll's revents */
+  const int revents = completion.res < 0 ? POLLERR : completion.res;
+  const auto poll_error = static_cast<bool>( revents & ( POLLERR | POLLNVAL ) );
+  if ( poll_error ) {
+    /* recoverable error? */
+    if ( not static_cast<bool>( revents & POLLNVAL ) ) {
+      if ( this_rule.recover() ) {
+        return;
+      }
+    }
+
+    if ( completion.res < 0 ) {
+      cerr << "error on file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\": " << strerror( -completion.res ) << "\n";
+    } else {
+      report_error( this_rule );
+    }
+    this_rule.cancel();
+    this_rule.cancel_requested = true;
+    return;
+  }
+
+  const auto poll_ready = static_cast<bool>( revents & static_cast<short>( this_rule.direction ) );
+  if ( ( revents & POLLHUP ) and not poll_ready ) {
+    // as with poll: if the _only_ condition was a hangup, this FD is defunct
+    this_rule.cancel();
+    this_rule.cancel_requested = true;
+    return;
+  }
+
+  if ( poll_ready ) {
+    _ready.push_back( &this_rule );
+  }
 }
 
 void EventLoop::summary( ostream& out ) const
@@ -283,11 +823,31 @@ void EventLoop::summary( ostream& out ) const
   }
 
   print_timer( "waiting for event", _waiting );
+
+  const array<string_view, 2> class_names { "real-time", "best-effort" };
+  for ( size_t i = 0; i < _deadlines.size(); i++ ) {
+    const auto& record = _deadlines[i];
+    if ( record.served == 0 ) {
+      continue;
+    }
+
+    out << "   missed deadlines (" << class_names[i] << "): ";
+    out << record.missed << " of " << record.served;
+    if ( record.missed ) {
+      out << ", worst ";
+      Timer::pp_ns( out, record.max_late_ns );
+      out << " late";
+    }
+    out << "\n";
+  }
 }
 
 void EventLoop::reset_summary()
 {
   _waiting.reset();
+  for ( auto& record : _deadlines ) {
+    record.reset();
+  }
   for ( auto& rule : _rule_categories ) {
     rule.timer.reset();
   }
@@ -1,13 +1,19 @@
 #pragma once
 
-#include <functional>
-#include <list>
-#include <memory>
+#include <array>
+#include <chrono>
+#include <optional>
 #include <ostream>
 #include <poll.h>
 #include <string_view>
+#include <sys/epoll.h>
+#include <vector>
 
 #include "file_descriptor.hh"
+#include "inline_function.hh"
+#include "io_uring.hh"
+#include "ring_buffer.hh"
+#include "slot_map.hh"
 #include "summarize.hh"
 #include "timer.hh"
 
@@ -22,9 +28,36 @@ public:
     Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
   };
 
+  //! How the loop waits for file descriptors.
+  enum class Backend
+  {
+    Poll,   //!< Rebuilds a pollfd for every rule on each wait.
+    Epoll,  //!< Keeps fds registered, and changes a registration only when a rule's interest flips.
+    IoUring //!< Submits each read rule's read (and a poll for every other rule) ahead of time, and collects the
+            //!< results in batches: one system call per wait, rather than a poll and then a read. Where the kernel
+            //!< lacks io_uring, the loop uses Backend::Poll instead.
+  };
+
+  //! How urgently a rule must be served once it's ready.
+  enum class Priority
+  {
+    RealTime,  //!< Every ready real-time rule is served on each wakeup, before any best-effort rule.
+    BestEffort //!< One ready best-effort rule is served on each wakeup, after the real-time rules: the first one
+               //!< without an fd if any is ready, otherwise the first one with an fd.
+  };
+
+  //! Returned by each call to EventLoop::wait_next_event.
+  enum class Result
+  {
+    Success, //!< At least one Rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
+             //!< EventLoop::wait_next_event.
+  };
+
 private:
-  using CallbackT = std::function<void( void )>;
-  using InterestT = std::function<bool( void )>;
+  using CallbackT = InlineFunction<void( void )>;
+  using InterestT = InlineFunction<bool( void )>;
 
   struct RuleCategory
   {
@@ -38,6 +71,9 @@ private:
     InterestT interest;
     CallbackT callback;
     bool cancel_requested;
+    Priority priority = Priority::BestEffort;
+    std::optional<std::chrono::nanoseconds> deadline {}; //!< From becoming ready to the callback returning.
+    uint64_t ready_ns = 0; //!< A non-fd rule with a deadline: the wakeup that found it interested (0 if none yet).
 
     BasicRule( const size_t s_category_id, const InterestT& s_interest, const CallbackT& s_callback );
   };
@@ -55,42 +91,147 @@ private:
             const CallbackT& s_cancel,
             const InterestT& s_recover );
 
+    //! With Backend::Epoll: a duplicate of fd, registered (with the rule's SlotKey as its data) until the rule goes
+    //! away.
+    //! Registering a duplicate lets two rules watch one fd, and keeps a closed fd from staying registered.
+    std::optional<FileDescriptor> registration {};
+    bool registered_interest = false; //!< The registration asks for Rule::direction (else only for errors).
+    bool always_ready = false;        //!< fd can't be registered (a regular file), so it's always ready.
+    bool timer = false;               //!< fd is a timerfd, whose expirations are read before the callback.
+    bool once = false;                //!< The rule is cancelled after the callback (a one-shot timer).
+    RingBuffer* read_into = nullptr;  //!< For a read rule, the buffer fd is read into before the callback.
+
+    //! \name With Backend::IoUring
+    //!@{
+    bool in_flight = false;        //!< The kernel has a request for this rule (with its SlotKey as the data).
+    bool cancel_submitted = false; //!< ... and has been asked to cancel it.
+    bool poll_first = false;       //!< A read found nothing (EAGAIN), so the next one waits for fd to be readable.
+    bool read_completed = false;   //!< Data was read into read_into, and the callback hasn't seen it yet.
+    //!@}
+
     //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
     //! \details This function is used internally by EventLoop; you will not need to call it
     unsigned int service_count() const;
+
+    //! FDRules move (within the SlotMap) but aren't copied
+    FDRule( FDRule&& other ) = default;
+    FDRule& operator=( FDRule&& other ) = default;
+    FDRule( const FDRule& other ) = delete;
+    FDRule& operator=( const FDRule& other ) = delete;
   };
 
+  static constexpr size_t max_rules = 1024; //!< Of each kind: rule storage is allocated once, up front.
+
+  Backend _backend;
   std::vector<RuleCategory> _rule_categories;
-  std::list<std::shared_ptr<FDRule>> _fd_rules {};
-  std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
+  SlotMap<FDRule> _fd_rules { max_rules };        //!< In the order they were added, which is their priority.
+  SlotMap<BasicRule> _non_fd_rules { max_rules }; //!< Likewise.
   Timer::Record _waiting {};
+  uint64_t _woke_ns; //!< When the last wait returned (so a non-fd rule interested now became ready since).
 
-public:
-  EventLoop();
-
-  //! Returned by each call to EventLoop::wait_next_event.
-  enum class Result
+  struct DeadlineRecord
   {
-    Success, //!< At least one Rule was triggered.
-    Timeout, //!< No rules were triggered before timeout.
-    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
-             //!< EventLoop::wait_next_event.
+    uint64_t served;      //!< Callbacks of rules with a deadline.
+    uint64_t missed;      //!< ... that returned after it.
+    uint64_t max_late_ns; //!< The furthest past the deadline one returned.
+
+    void reset() { served = missed = max_late_ns = 0; }
   };
 
+  std::array<DeadlineRecord, 2> _deadlines {}; //!< For each Priority.
+  std::vector<FDRule*> _ready {};              //!< The ready fd rules, in the order they were added.
+
+  std::vector<pollfd> _pollfds {};           //!< With Backend::Poll: one for each fd rule.
+  std::optional<FileDescriptor> _epoll {};   //!< With Backend::Epoll: the epoll instance.
+  std::vector<epoll_event> _epoll_events {}; //!< Filled by epoll_wait.
+  std::optional<IoUring> _uring {};          //!< With Backend::IoUring: the ring.
+
+  static constexpr unsigned int uring_entries = 256;
+  static constexpr uint64_t no_rule = -1; //!< The data of a request whose result is of no interest.
+
+  //! A rule's SlotKey, as the data of an epoll registration or io_uring request (and back).
+  static uint64_t encode_key( const SlotKey key ) { return uint64_t( key.index ) << 32 | key.generation; }
+  static SlotKey decode_key( const uint64_t data ) { return { uint32_t( data >> 32 ), uint32_t( data ) }; }
+
+  //! If a rule can't be served any more, call its cancel callback (unless it was cancelled explicitly).
+  static bool defunct( FDRule& rule );
+
+  //! Describe an error on a rule's fd.
+  void report_error( const FDRule& rule ) const;
+
+  //! A ready rule that still wants its callback (a read rule always does, once its read has completed).
+  static bool wants_service( FDRule& rule );
+
+  //! Execute a ready fd rule's callback, and check that it did something.
+  void serve( FDRule& rule, const uint64_t ready_ns );
+
+  //! Execute a ready non-fd rule's callback until it loses interest.
+  void serve_until_satisfied( BasicRule& rule, const uint64_t ready_ns );
+
+  //! A non-fd rule has been found interested: if it has a deadline, it has been ready since the last wakeup (or
+  //! since an earlier one, if it has been waiting). \returns when it became ready
+  uint64_t mark_ready( BasicRule& rule ) const;
+
+  //! Count a served rule against its deadline, if it has one.
+  void record_deadline( const BasicRule& rule, const uint64_t ready_ns );
+
+  //! A rule on a new timerfd that first expires at `first`, then every `period` (or only once if it's zero).
+  SlotKey add_timer( const size_t category_id,
+                     const std::chrono::steady_clock::time_point first,
+                     const std::chrono::nanoseconds period,
+                     const CallbackT& callback );
+
+  //! Fill _ready, retiring defunct and failed rules along the way.
+  Result wait_with_poll( const int timeout_ms );
+  Result wait_with_epoll( const int timeout_ms );
+  void update_registration( FDRule& rule, const SlotKey key, const bool interested );
+  void unregister( FDRule& rule );
+  Result wait_with_io_uring( const int timeout_ms );
+  void submit( FDRule& rule, const SlotKey key );
+  void complete( const io_uring_cqe& completion );
+
+public:
+  explicit EventLoop( const Backend backend = Backend::Epoll );
+
+  //! With Backend::IoUring, waits for the kernel to return (or cancel) its outstanding requests.
+  ~EventLoop();
+
+  //! The backend in use, which is Backend::Poll if Backend::IoUring was asked for but isn't available.
+  Backend backend() const { return _backend; }
+
   size_t add_category( const std::string& name );
 
+  //! Refers to a rule, until the rule is cancelled or retired (after which it does nothing). Must not outlive the
+  //! EventLoop.
   class RuleHandle
   {
-    std::weak_ptr<BasicRule> rule_weak_ptr_;
+    EventLoop* loop_;
+    bool fd_rule_;
+    SlotKey key_;
+
+    BasicRule* rule() const;
+
+    friend class EventLoop;
 
   public:
-    template<class RuleType>
-    RuleHandle( const std::shared_ptr<RuleType> x )
-      : rule_weak_ptr_( x )
+    RuleHandle( EventLoop& loop, const bool fd_rule, const SlotKey key )
+      : loop_( &loop )
+      , fd_rule_( fd_rule )
+      , key_( key )
     {
     }
 
     void cancel();
+
+    //! Rules are Priority::BestEffort unless set otherwise.
+    RuleHandle& set_priority( const Priority priority );
+
+    //! Count a missed deadline (in EventLoop::summary) whenever the callback returns more than `deadline` after the
+    //! rule became ready. A deadline in samples is `samples * 1e9 / sample_rate` ns.
+    //! \details An fd rule becomes ready when the wait that found its fd ready returns. A rule without an fd is
+    //! taken to have become ready when the loop woke up before the first check that found it interested, so the
+    //! other callbacks run since then count against its deadline.
+    RuleHandle& set_deadline( const std::chrono::nanoseconds deadline );
   };
 
   RuleHandle add_rule(
@@ -107,7 +248,33 @@ public:
     const CallbackT& callback,
     const InterestT& interest = [] { return true; } );
 
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  //! Reads fd into `buffer` whenever there's data and room for it, then calls `callback` to consume it (and
+  //! `cancel` at EOF). With Backend::IoUring the read is submitted ahead of time, straight into
+  //! buffer.writable_region(), so data arrives without a system call of its own.
+  //! \details Nothing else may push into `buffer` while the rule exists, and the buffer must outlive the EventLoop
+  //! (the kernel may still have a read into it until the loop is destroyed).
+  RuleHandle add_read_rule(
+    const size_t category_id,
+    const FileDescriptor& fd,
+    RingBuffer& buffer,
+    const CallbackT& callback,
+    const CallbackT& cancel = [] {} );
+
+  //! Calls `callback` every `period`, starting one period from now. The rule is an fd rule on a timerfd, so it
+  //! costs nothing between firings, and it fires when the timer expires rather than on the next wakeup. If the
+  //! loop falls behind by more than a period, the missed firings are merged into one.
+  RuleHandle add_timer_rule( const size_t category_id,
+                             const std::chrono::nanoseconds period,
+                             const CallbackT& callback );
+
+  //! Calls `callback` once, at `deadline` (or as soon as possible if that has passed), then removes the rule.
+  RuleHandle add_timer_rule( const size_t category_id,
+                             const std::chrono::steady_clock::time_point deadline,
+                             const CallbackT& callback );
+
+  //! Calls [poll(2)](\ref man2::poll), [epoll_wait(2)](\ref man2::epoll_wait) or
+  //! [io_uring_enter(2)](\ref man2::io_uring_enter), and then executes the callbacks of every ready real-time rule,
+  //! then of one ready best-effort rule (see Priority::BestEffort).
   Result wait_next_event( const int timeout_ms );
 
   void summary( std::ostream& out ) const override;
@@ -119,6 +286,18 @@ public:
   {
     return add_rule( add_category( name ), std::forward<Targs>( Fargs )... );
   }
+
+  template<typename... Targs>
+  auto add_read_rule( const std::string& name, Targs&&... Fargs )
+  {
+    return add_read_rule( add_category( name ), std::forward<Targs>( Fargs )... );
+  }
+
+  template<typename... Targs>
+  auto add_timer_rule( const std::string& name, Targs&&... Fargs )
+  {
+    return add_timer_rule( add_category( name ), std::forward<Targs>( Fargs )... );
+  }
 };
 
 using Direction = EventLoop::Direction;
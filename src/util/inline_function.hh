@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//! A std::function that never allocates: the callable is stored inside the object, and one that doesn't fit in
+//! `Capacity` bytes is a compile-time error. Calling one goes through a single function pointer.
+template<typename Signature, size_t Capacity = 96>
+class InlineFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InlineFunction<R( Args... ), Capacity>
+{
+  //! How to call, copy, move and destroy the stored callable.
+  struct Operations
+  {
+    R ( *invoke )( void* storage, Args&&... args );
+    void ( *copy )( void* destination, const void* source );
+    void ( *move )( void* destination, void* source );
+    void ( *destroy )( void* storage );
+  };
+
+  template<typename F>
+  static constexpr Operations operations_for {
+    []( void* storage, Args&&... args ) -> R {
+      return ( *static_cast<F*>( storage ) )( std::forward<Args>( args )... );
+    },
+    []( void* destination, const void* source ) { new ( destination ) F( *static_cast<const F*>( source ) ); },
+    []( void* destination, void* source ) { new ( destination ) F( std::move( *static_cast<F*>( source ) ) ); },
+    []( void* storage ) { static_cast<F*>( storage )->~F(); } };
+
+  alignas( std::max_align_t ) mutable unsigned char storage_[Capacity];
+  const Operations* operations_ = nullptr; //!< Null when empty.
+
+  void reset()
+  {
+    if ( operations_ ) {
+      operations_->destroy( storage_ );
+      operations_ = nullptr;
+    }
+  }
+
+public:
+  InlineFunction()
+    : storage_()
+  {
+  }
+
+  template<typename F, typename = std::enable_if_t<not std::is_same_v<std::decay_t<F>, InlineFunction>>>
+  InlineFunction( F&& callable )
+    : storage_()
+    , operations_( &operations_for<std::decay_t<F>> )
+  {
+    using Stored = std::decay_t<F>;
+    static_assert( sizeof( Stored ) <= Capacity, "InlineFunction: callable is too big (capture less)" );
+    static_assert( alignof( Stored ) <= alignof( std::max_align_t ), "InlineFunction: callable is overaligned" );
+    static_assert( std::is_invocable_r_v<R, Stored&, Args...>, "InlineFunction: callable has the wrong signature" );
+
+    new ( storage_ ) Stored( std::forward<F>( callable ) );
+  }
+
+  InlineFunction( const InlineFunction& other )
+    : storage_()
+    , operations_( other.operations_ )
+  {
+    if ( operations_ ) {
+      operations_->copy( storage_, other.storage_ );
+    }
+  }
+
+  InlineFunction( InlineFunction&& other )
+    : storage_()
+    , operations_( other.operations_ )
+  {
+    if ( operations_ ) {
+      operations_->move( storage_, other.storage_ );
+    }
+  }
+
+  InlineFunction& operator=( const InlineFunction& other )
+  {
+    if ( this != &other ) {
+      reset();
+      if ( other.operations_ ) {
+        other.operations_->copy( storage_, other.storage_ );
+        operations_ = other.operations_;
+      }
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=( InlineFunction&& other )
+  {
+    if ( this != &other ) {
+      reset();
+      if ( other.operations_ ) {
+        other.operations_->move( storage_, other.storage_ );
+        operations_ = other.operations_;
+      }
+    }
+    return *this;
+  }
+
+  ~InlineFunction() { reset(); }
+
+  R operator()( Args... args ) const
+  {
+    if ( not operations_ ) {
+      throw std::bad_function_call();
+    }
+    return operations_->invoke( storage_, std::forward<Args>( args )... );
+  }
+
+  explicit operator bool() const { return operations_; }
+};
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "exception.hh"
+#include "io_uring.hh"
+
+using namespace std;
+
+static io_uring_params setup_parameters()
+{
+  io_uring_params params {};
+  params.flags = IORING_SETUP_CLAMP;
+  return params;
+}
+
+IoUring::IoUring( const unsigned entries )
+  : params_( setup_parameters() )
+  , fd_( CheckSystemCall( "io_uring_setup", syscall( __NR_io_uring_setup, entries, &params_ ) ) )
+  , rings_( [&] {
+    /* needs the queues mapped together, and io_uring_enter to take a timeout */
+    for ( const auto feature : { IORING_FEAT_SINGLE_MMAP, IORING_FEAT_NODROP, IORING_FEAT_EXT_ARG } ) {
+      if ( not( params_.features & feature ) ) {
+        throw runtime_error( "io_uring: kernel lacks a needed feature (" + to_string( feature ) + ")" );
+      }
+    }
+    const size_t length = max( params_.sq_off.array + params_.sq_entries * sizeof( unsigned ),
+                               params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ) );
+    return MMap_Region {
+      nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_.fd_num(), IORING_OFF_SQ_RING };
+  }() )
+  , sqes_( nullptr,
+           params_.sq_entries * sizeof( io_uring_sqe ),
+           PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE,
+           fd_.fd_num(),
+           IORING_OFF_SQES )
+  , sq_head_( reinterpret_cast<unsigned*>( rings_.addr() + params_.sq_off.head ) )
+  , sq_tail_( reinterpret_cast<unsigned*>( rings_.addr() + params_.sq_off.tail ) )
+  , sq_array_( reinterpret_cast<unsigned*>( rings_.addr() + params_.sq_off.array ) )
+  , cq_head_( reinterpret_cast<unsigned*>( rings_.addr() + params_.cq_off.head ) )
+  , cq_tail_( reinterpret_cast<unsigned*>( rings_.addr() + params_.cq_off.tail ) )
+  , cqes_( reinterpret_cast<io_uring_cqe*>( rings_.addr() + params_.cq_off.cqes ) )
+  , sq_local_tail_( *sq_tail_ )
+{
+}
+
+io_uring_sqe& IoUring::prepare()
+{
+  if ( sq_local_tail_ - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ) >= params_.sq_entries ) {
+    submit_and_wait( 0, 0 );
+    if ( sq_local_tail_ - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE ) >= params_.sq_entries ) {
+      throw runtime_error( "io_uring: submission queue is full" );
+    }
+  }
+
+  /* the entries are used in order, so slot i of the array always names entry i */
+  const unsigned index = sq_local_tail_++ & ( params_.sq_entries - 1 );
+  sq_array_[index] = index;
+  io_uring_sqe& entry = reinterpret_cast<io_uring_sqe*>( sqes_.addr() )[index];
+  memset( &entry, 0, sizeof( entry ) );
+  return entry;
+}
+
+void IoUring::submit_and_wait( const unsigned wait_for, const int timeout_ms )
+{
+  /* publish the prepared entries */
+  __atomic_store_n( sq_tail_, sq_local_tail_, __ATOMIC_RELEASE );
+  const unsigned to_submit = sq_local_tail_ - __atomic_load_n( sq_head_, __ATOMIC_ACQUIRE );
+
+  if ( to_submit == 0 and wait_for == 0 ) {
+    return;
+  }
+
+  __kernel_timespec timeout { timeout_ms / 1000, ( timeout_ms % 1000 ) * 1000000LL };
+  io_uring_getevents_arg argument {};
+  if ( timeout_ms >= 0 ) {
+    argument.ts = reinterpret_cast<uint64_t>( &timeout );
+  }
+
+  const unsigned flags = IORING_ENTER_EXT_ARG | ( wait_for ? IORING_ENTER_GETEVENTS : 0 );
+  if ( syscall( __NR_io_uring_enter, fd_.fd_num(), to_submit, wait_for, flags, &argument, sizeof( argument ) )
+       < 0 ) {
+    /* ETIME: timed out; EINTR: interrupted by a signal; EBUSY: results are backed up (the caller drains them) */
+    if ( errno != ETIME and errno != EINTR and errno != EBUSY ) {
+      throw unix_error( "io_uring_enter" );
+    }
+  }
+}
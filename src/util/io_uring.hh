@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <linux/io_uring.h>
+
+#include "file_descriptor.hh"
+#include "mmap.hh"
+
+//! An [io_uring(7)](\ref man7::io_uring): a queue of requests the kernel works on asynchronously, and a queue of
+//! their results, both shared with the kernel so that one system call can submit a batch of requests and collect a
+//! batch of results.
+//! \details Driven with the raw system calls (no liburing). The constructor throws if the kernel lacks io_uring
+//! (it was added in Linux 5.1 and can be disabled) or a feature used here, which needs Linux 5.11.
+class IoUring
+{
+  io_uring_params params_; //!< Filled in by the kernel: the queues' sizes and layout, and its features.
+  FileDescriptor fd_;
+  MMap_Region rings_; //!< The submission and completion queues' heads, tails and arrays (one mapping).
+  MMap_Region sqes_;  //!< The submission queue entries.
+
+  //! \name Views into the rings
+  //!@{
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  io_uring_cqe* cqes_;
+  //!@}
+
+  unsigned sq_local_tail_; //!< Includes entries prepared but not yet handed to the kernel.
+
+public:
+  //! Room for `entries` requests at a time (and twice as many results).
+  explicit IoUring( const unsigned entries );
+
+  //! A zeroed submission queue entry to fill in, which goes to the kernel on the next submit_and_wait().
+  //! If the queue is full, the entries already in it are submitted first.
+  io_uring_sqe& prepare();
+
+  //! Submit the prepared entries, then wait until at least `wait_for` results are ready or `timeout_ms` has
+  //! passed (-1 waits forever).
+  void submit_and_wait( const unsigned wait_for, const int timeout_ms );
+
+  //! Call `handler` with each result, in the order the kernel posted them, and mark them consumed.
+  //! \returns the number of results
+  template<typename F>
+  unsigned drain_completions( F&& handler )
+  {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE );
+    const unsigned count = tail - head;
+    for ( ; head != tail; head++ ) {
+      handler( cqes_[head & ( params_.cq_entries - 1 )] );
+    }
+    __atomic_store_n( cq_head_, head, __ATOMIC_RELEASE );
+    return count;
+  }
+
+  //! An IoUring can't be copied (the rings are mapped once)
+  IoUring( const IoUring& other ) = delete;
+  IoUring& operator=( const IoUring& other ) = delete;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+//! Refers to a value in a SlotMap, and knows when that value has been erased.
+struct SlotKey
+{
+  uint32_t index = std::numeric_limits<uint32_t>::max(); //!< Which slot.
+  uint32_t generation = 0;                               //!< How many times the slot had been reused.
+};
+
+//! Values in one contiguous array, in the order they were inserted, found by SlotKeys that don't dangle: a key
+//! whose value has been erased finds nothing, even after its slot is reused. Storage is reserved up front and never
+//! reallocated, so a reference to a value stays valid while values are inserted (but not when a value before it is
+//! erased, which moves the ones after it down).
+template<typename T>
+class SlotMap
+{
+  static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+  struct Slot
+  {
+    uint32_t generation;
+    uint32_t position; //!< In values_ while the slot is in use, else the next free slot.
+  };
+
+  std::vector<T> values_ {};
+  std::vector<uint32_t> slot_of_ {}; //!< For each value, the slot that refers to it.
+  std::vector<Slot> slots_ {};
+  uint32_t free_slot_ = none;
+
+public:
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  explicit SlotMap( const size_t capacity )
+  {
+    values_.reserve( capacity );
+    slot_of_.reserve( capacity );
+    slots_.reserve( capacity );
+  }
+
+  template<typename... Targs>
+  SlotKey emplace( Targs&&... Fargs )
+  {
+    if ( values_.size() >= values_.capacity() ) {
+      throw std::runtime_error( "SlotMap: full" );
+    }
+
+    uint32_t index = free_slot_;
+    if ( index == none ) {
+      index = slots_.size();
+      slots_.push_back( { 0, none } );
+    } else {
+      free_slot_ = slots_[index].position;
+    }
+
+    values_.emplace_back( std::forward<Targs>( Fargs )... );
+    slot_of_.push_back( index );
+    slots_[index].position = values_.size() - 1;
+
+    return { index, slots_[index].generation };
+  }
+
+  //! \returns the value, or nullptr if it has been erased
+  T* find( const SlotKey key )
+  {
+    if ( key.index >= slots_.size() or slots_[key.index].generation != key.generation ) {
+      return nullptr;
+    }
+    return &values_[slots_[key.index].position];
+  }
+
+  SlotKey key( const const_iterator it ) const
+  {
+    const uint32_t index = slot_of_[it - values_.begin()];
+    return { index, slots_[index].generation };
+  }
+
+  //! Erase a value, keeping the rest in order. \returns the iterator following it
+  iterator erase( const iterator it )
+  {
+    const size_t position = it - values_.begin();
+    const uint32_t index = slot_of_[position];
+
+    slots_[index].generation++;
+    slots_[index].position = free_slot_;
+    free_slot_ = index;
+
+    slot_of_.erase( slot_of_.begin() + position );
+    for ( size_t i = position; i < slot_of_.size(); i++ ) {
+      slots_[slot_of_[i]].position = i;
+    }
+    return values_.erase( it );
+  }
+
+  iterator begin() { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator begin() const { return values_.begin(); }
+  const_iterator end() const { return values_.end(); }
+
+  size_t size() const { return values_.size(); }
+  bool empty() const { return values_.empty(); }
+};
@@ -5,7 +5,9 @@
 #include "spans.hh"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <type_traits>
 
 template<typename T>
 class TypedRingStorage : public RingStorage
@@ -75,6 +77,97 @@ public:
   }
 };
 
+/* TypedRingBuffer that one thread (the producer) pushes to while another (the consumer) pops from, without
+   locks. Only the producer may call writable_region() and push(); only the consumer may call readable_region()
+   and pop(). Each side works on a whole region at a time, so a batch of elements costs one atomic store. */
+template<typename T>
+class SPSCRingBuffer : public TypedRingStorage<T>
+{
+  static_assert( std::is_trivially_copyable_v<T>, "SPSCRingBuffer elements are copied between threads as bytes" );
+
+  /* each side's counter shares a cache line only with that side's cached copy of the other counter, so the two
+     threads touch each other's line only when their cached copy runs out */
+  struct alignas( 64 ) ProducerState
+  {
+    std::atomic<size_t> num_pushed { 0 };
+    size_t known_popped = 0;
+  };
+
+  struct alignas( 64 ) ConsumerState
+  {
+    std::atomic<size_t> num_popped { 0 };
+    size_t known_pushed = 0;
+  };
+
+  ProducerState producer_ {};
+  ConsumerState consumer_ {};
+
+public:
+  using TypedRingStorage<T>::TypedRingStorage;
+  using TypedRingStorage<T>::capacity;
+
+  /* approximate unless called from the side that owns the counter */
+  size_t num_pushed() const { return producer_.num_pushed.load( std::memory_order_acquire ); }
+  size_t num_popped() const { return consumer_.num_popped.load( std::memory_order_acquire ); }
+  size_t num_stored() const { return num_pushed() - num_popped(); }
+
+  /* producer */
+  span<T> writable_region()
+  {
+    const size_t pushed = producer_.num_pushed.load( std::memory_order_relaxed );
+    if ( pushed - producer_.known_popped == capacity() ) {
+      producer_.known_popped = consumer_.num_popped.load( std::memory_order_acquire );
+    }
+
+    return TypedRingStorage<T>::mutable_storage( pushed % capacity() )
+      .substr( 0, capacity() - ( pushed - producer_.known_popped ) );
+  }
+
+  void push( const size_t num_elems )
+  {
+    const size_t pushed = producer_.num_pushed.load( std::memory_order_relaxed );
+    if ( num_elems > capacity() - ( pushed - producer_.known_popped ) ) {
+      throw std::runtime_error( "SPSCRingBuffer::push exceeded size of writable region" );
+    }
+
+    producer_.num_pushed.store( pushed + num_elems, std::memory_order_release );
+  }
+
+  /* producer: push one element, or return false if the buffer is full */
+  bool try_push( const T& elem )
+  {
+    span<T> region = writable_region();
+    if ( region.size() == 0 ) {
+      return false;
+    }
+
+    region[0] = elem;
+    push( 1 );
+    return true;
+  }
+
+  /* consumer */
+  span_view<T> readable_region()
+  {
+    const size_t popped = consumer_.num_popped.load( std::memory_order_relaxed );
+    if ( consumer_.known_pushed == popped ) {
+      consumer_.known_pushed = producer_.num_pushed.load( std::memory_order_acquire );
+    }
+
+    return TypedRingStorage<T>::storage( popped % capacity() ).substr( 0, consumer_.known_pushed - popped );
+  }
+
+  void pop( const size_t num_elems )
+  {
+    const size_t popped = consumer_.num_popped.load( std::memory_order_relaxed );
+    if ( num_elems > consumer_.known_pushed - popped ) {
+      throw std::runtime_error( "SPSCRingBuffer::pop exceeded size of readable region" );
+    }
+
+    consumer_.num_popped.store( popped + num_elems, std::memory_order_release );
+  }
+};
+
 template<typename T>
 class EndlessBuffer : TypedRingStorage<T>
 {